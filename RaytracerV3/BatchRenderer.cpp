@@ -0,0 +1,604 @@
+//
+//  BatchRenderer.cpp
+//  RaytracerV3
+//
+
+#include "BatchRenderer.h"
+#include "PhotonMapper.h"
+#include "ImageIO.h"
+#include "DistributedRenderer.h"
+#include "RenderCheckpoint.h"
+#include "CameraPath.h"
+#include "Denoiser.h"
+#include "Platform/Progress.h"
+#include "Platform/Stopwatch.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace Main;
+
+BatchOptions::BatchOptions():
+    scene("cornell_fog"),
+    width(1024),
+    height(768),
+    spp(1),
+    gatherSamples(-1),
+    threads(0),
+    adaptive(false),
+    threshold(-1.0),
+    output("render.ppm"),
+    timeBudget(0.0),
+    minSpp(1),
+    denoise(false),
+    coordinatorPort(-1),
+    spawnWorkers(0),
+    photonFile("photons.pmap"),
+    checkpointInterval(60.0),
+    resume(false),
+    seed(0),
+    hasSeed(false),
+    sampler(STRATIFIED_SAMPLER),
+    photonIndex(KD_TREE),
+    gridCellSize(0.0f)
+{
+    crop.x0 = crop.y0 = crop.x1 = crop.y1 = 0;
+}
+
+BatchRenderer::BatchRenderer(int argc, const char *argv[]):
+    options(),
+    scene(),
+    sceneLoader(scene)
+{
+    valid = parseArguments(argc, argv);
+}
+
+void
+BatchRenderer::printUsage(const char *program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --scene NAME      cornell_fog, cave, cornell or spheres (cornell_fog)\n"
+              << "  --width N         image width (1024)\n"
+              << "  --height N        image height (768)\n"
+              << "  --spp N           camera samples per pixel (1)\n"
+              << "  --gather N        final gather samples (scene default)\n"
+              << "  --adaptive        distribute spp samples per pixel on average\n"
+              << "                    to the noisiest pixels\n"
+              << "  --threshold E     adaptive relative error threshold (scene default)\n"
+              << "  --denoise         filter the image guided by the normals, depth and\n"
+              << "                    albedo of the primary hits\n"
+              << "  --threads N       render threads, 0 uses all cores (0)\n"
+              << "  --output FILE     output image, .ppm, .hdr or .pfm (render.ppm)\n"
+              << "  --crop X0,Y0,X1,Y1  only trace pixels X0<=x<X1, Y0<=y<Y1 (from the\n"
+              << "                    top left), the rest of the image stays black\n"
+              << "  --time-budget S   render for at most S seconds per frame, the\n"
+              << "                    samples per pixel follow from the budget\n"
+              << "  --min-spp N       samples per pixel even beyond the budget (1)\n"
+              << "  --sequence FILE   render the camera keyframes in FILE, one image per\n"
+              << "                    frame (OUTPUT with a %d pattern or a _NNNN suffix)\n"
+              << "  --coordinator P   render with worker processes, listen on port P\n"
+              << "                    (0 picks a free port)\n"
+              << "  --spawn-workers N start N local workers (with --coordinator)\n"
+              << "  --photon-file F   photon maps shared with the workers (photons.pmap)\n"
+              << "  --worker H:P      render tiles for the coordinator at host H, port P\n"
+              << "  --checkpoint F    save the render state to F periodically\n"
+              << "  --checkpoint-interval S  seconds between checkpoints (60)\n"
+              << "  --resume          continue from the checkpoint F\n"
+              << "  --seed N          random seed (0)\n"
+              << "  --sampler NAME    stratified, sobol or halton samples for the camera,\n"
+              << "                    the final gather and the lights (stratified)\n"
+              << "  --photon-index I  kdtree or grid index of the photon maps (kdtree)\n"
+              << "  --grid-cell S     grid cell size, 0 uses the photon search radius (0)\n"
+              << "  --help            show this message" << std::endl;
+}
+
+bool
+BatchRenderer::parseArguments(int argc, const char *argv[])
+{
+    options.program = argv[0];
+    for (int i=1; i<argc; i++)
+    {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+        {
+            printUsage(argv[0]);
+            return false;
+        }
+        if (strcmp(arg, "--adaptive") == 0)
+        {
+            options.adaptive = true;
+            continue;
+        }
+        if (strcmp(arg, "--denoise") == 0)
+        {
+            options.denoise = true;
+            continue;
+        }
+        if (strcmp(arg, "--resume") == 0)
+        {
+            options.resume = true;
+            continue;
+        }
+        if (i+1 >= argc)
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+        const char *value = argv[++i];
+        if (strcmp(arg, "--scene") == 0)
+            options.scene = value;
+        else if (strcmp(arg, "--width") == 0)
+            options.width = atoi(value);
+        else if (strcmp(arg, "--height") == 0)
+            options.height = atoi(value);
+        else if (strcmp(arg, "--spp") == 0)
+            options.spp = atoi(value);
+        else if (strcmp(arg, "--gather") == 0)
+            options.gatherSamples = atoi(value);
+        else if (strcmp(arg, "--threshold") == 0)
+            options.threshold = atof(value);
+        else if (strcmp(arg, "--threads") == 0)
+            options.threads = atoi(value);
+        else if (strcmp(arg, "--output") == 0)
+            options.output = value;
+        else if (strcmp(arg, "--coordinator") == 0)
+            options.coordinatorPort = atoi(value);
+        else if (strcmp(arg, "--spawn-workers") == 0)
+            options.spawnWorkers = atoi(value);
+        else if (strcmp(arg, "--photon-file") == 0)
+            options.photonFile = value;
+        else if (strcmp(arg, "--worker") == 0)
+            options.workerAddress = value;
+        else if (strcmp(arg, "--checkpoint") == 0)
+            options.checkpoint = value;
+        else if (strcmp(arg, "--checkpoint-interval") == 0)
+            options.checkpointInterval = atof(value);
+        else if (strcmp(arg, "--seed") == 0)
+        {
+            options.seed = strtoull(value, NULL, 10);
+            options.hasSeed = true;
+        }
+        else if (strcmp(arg, "--time-budget") == 0)
+            options.timeBudget = atof(value);
+        else if (strcmp(arg, "--min-spp") == 0)
+            options.minSpp = atoi(value);
+        else if (strcmp(arg, "--sequence") == 0)
+            options.sequence = value;
+        else if (strcmp(arg, "--sampler") == 0)
+        {
+            if (!Sampler::parse(value, options.sampler))
+            {
+                std::cerr << "Unknown sampler " << value << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--photon-index") == 0)
+        {
+            if (strcmp(value, "kdtree") == 0)
+                options.photonIndex = KD_TREE;
+            else if (strcmp(value, "grid") == 0)
+                options.photonIndex = HASH_GRID;
+            else
+            {
+                std::cerr << "Unknown photon index " << value << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--grid-cell") == 0)
+            options.gridCellSize = atof(value);
+        else if (strcmp(arg, "--crop") == 0)
+        {
+            if (sscanf(value, "%d,%d,%d,%d", &options.crop.x0, &options.crop.y0,
+                       &options.crop.x1, &options.crop.y1) != 4)
+            {
+                std::cerr << "Invalid crop window " << value << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    
+    if (options.width <= 0 || options.height <= 0 || options.spp <= 0 || options.threads < 0)
+    {
+        std::cerr << "Invalid resolution, sample or thread count" << std::endl;
+        return false;
+    }
+    if (options.crop.x1 > 0 || options.crop.y1 > 0)
+    {
+        // flip to image rows, which start at the bottom
+        const int y0 = options.height-std::min(options.crop.y1, options.height);
+        const int y1 = options.height-std::max(options.crop.y0, 0);
+        options.crop.x0 = std::max(options.crop.x0, 0);
+        options.crop.x1 = std::min(options.crop.x1, options.width);
+        options.crop.y0 = y0;
+        options.crop.y1 = y1;
+        if (options.crop.x1 <= options.crop.x0 || options.crop.y1 <= options.crop.y0)
+        {
+            std::cerr << "Empty crop window" << std::endl;
+            return false;
+        }
+    }
+    if (options.resume && options.checkpoint.empty())
+    {
+        std::cerr << "--resume needs --checkpoint" << std::endl;
+        return false;
+    }
+    if (!options.checkpoint.empty() && (options.adaptive || options.timeBudget > 0.0 ||
+                                        options.crop.x1 > options.crop.x0))
+    {
+        std::cerr << "--checkpoint renders whole images with spp samples, without "
+                     "--adaptive, --time-budget or --crop" << std::endl;
+        return false;
+    }
+    if (options.timeBudget > 0.0 && (options.minSpp < 1 || options.adaptive ||
+                                     options.crop.x1 > options.crop.x0))
+    {
+        std::cerr << "--time-budget needs --min-spp >= 1, without --adaptive or --crop" << std::endl;
+        return false;
+    }
+    if (!options.sequence.empty() && (options.coordinatorPort >= 0 || !options.checkpoint.empty()))
+    {
+        std::cerr << "--sequence renders locally, without checkpoints" << std::endl;
+        return false;
+    }
+    if (options.coordinatorPort >= 0 && (options.adaptive || options.timeBudget > 0.0 ||
+                                         options.crop.x1 > options.crop.x0))
+    {
+        std::cerr << "--coordinator renders whole images with spp samples, without "
+                     "--adaptive, --time-budget or --crop" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool
+BatchRenderer::renderCheckpointed(PhotonMapper &renderer)
+{
+    std::vector<TileScheduler::Tile> tiles =
+        TileScheduler::tiles(options.width, options.height, scene.tileSize);
+    
+    RenderCheckpoint state;
+    state.scene = options.scene;
+    state.width = options.width;
+    state.height = options.height;
+    state.spp = options.spp;
+    state.gatherSamples = scene._monteCarloSamples;
+    state.tileSize = scene.tileSize;
+    state.tileDone.assign(tiles.size(), 0);
+    state.seed = scene.seed;
+    state.sampler = int(scene.sampler);
+    
+    const std::string photonFile = RenderCheckpoint::photonFile(options.checkpoint);
+    if (options.resume)
+    {
+        // a mistyped option must not overwrite the progress of a long render
+        RenderCheckpoint saved;
+        if (!saved.load(options.checkpoint))
+        {
+            std::cerr << "Cannot read the checkpoint " << options.checkpoint << std::endl;
+            return false;
+        }
+        if (!saved.matches(state) || saved.tileDone.size() != tiles.size())
+        {
+            std::cerr << "The checkpoint " << options.checkpoint
+                      << " belongs to a render with other settings" << std::endl;
+            return false;
+        }
+        if (!scene.loadPhotonMaps(photonFile))
+        {
+            std::cerr << "Cannot read the photon maps " << photonFile << std::endl;
+            return false;
+        }
+        state.tileDone = saved.tileDone;
+        state.seed = scene.seed = saved.seed;
+        renderer.setImage(saved.image);
+        std::cout << "Resuming from " << options.checkpoint << std::endl;
+    }
+    else
+    {
+        scene.emit_scatterPhotons();
+        if (!scene.savePhotonMaps(photonFile))
+        {
+            return false;
+        }
+        Util::Array2D<Math::Color4f> blank(options.width, options.height);
+        blank.reset(Math::Color4f(0.0f));
+        renderer.setImage(blank);
+    }
+    
+    int remaining = 0;
+    for (char done: state.tileDone)
+    {
+        remaining += !done;
+    }
+    
+    // Every pixel has its own random stream (see Scene::seedPixel), so the
+    // resumed tiles come out as in an uninterrupted render
+    Platform::Stopwatch sinceCheckpoint;
+    sinceCheckpoint.start();
+    Platform::Progress progress("Rendering tiles", remaining);
+    for (size_t t=0; t<tiles.size(); t++)
+    {
+        if (state.tileDone[t])
+            continue;
+        renderer.renderTile(scene, tiles[t], options.spp);
+        state.tileDone[t] = 1;
+        progress.step();
+        
+        if (sinceCheckpoint.elapsedSeconds() >= options.checkpointInterval)
+        {
+            state.save(options.checkpoint, renderer.image());
+            sinceCheckpoint.restart();
+        }
+    }
+    progress.done();
+    
+    state.save(options.checkpoint, renderer.image());
+    return true;
+}
+
+int
+BatchRenderer::run()
+{
+    if (!valid)
+    {
+        return -1;
+    }
+    if (!options.workerAddress.empty())
+    {
+        // the coordinator tells us what to render
+        RenderWorker worker(options);
+        return worker.run();
+    }
+    if (options.hasSeed)
+    {
+        scene.seed = options.seed;
+    }
+    scene.sampler = options.sampler;
+    if (!sceneLoader.loadScene(options.scene))
+    {
+        return -1;
+    }
+    
+    scene.camera.setResolution(options.width, options.height);
+    scene.renderThreads = options.threads;
+#ifdef _OPENMP
+    // photon tracing and the irradiance precomputation use plain omp loops
+    if (options.threads > 0)
+    {
+        omp_set_num_threads(options.threads);
+    }
+#endif
+    if (options.gatherSamples >= 0)
+    {
+        scene._monteCarloSamples = options.gatherSamples;
+    }
+    scene.photonMapIndex = options.photonIndex;
+    scene.photonGridCellSize = options.gridCellSize;
+    
+    if (options.threshold >= 0.0)
+    {
+        scene.adaptiveThreshold = options.threshold;
+    }
+    scene.denoise = options.denoise;
+    
+    if (options.coordinatorPort >= 0)
+    {
+        Util::Array2D<Math::Color4f> image;
+        RenderCoordinator coordinator(scene, options);
+        if (!coordinator.run(image))
+        {
+            return -1;
+        }
+        if (scene.denoise)
+        {
+            Denoiser denoiser;
+            denoiser.iterations = scene.denoiseIterations;
+            denoiser.captureFeatures(scene);
+            denoiser.filter(image, scene.renderThreads);
+        }
+        if (!writeImage(options.output, image))
+        {
+            return -1;
+        }
+        std::cout << "Wrote " << options.output << std::endl;
+        return 0;
+    }
+    
+    if (!options.checkpoint.empty())
+    {
+        PhotonMapper renderer;
+        if (!renderCheckpointed(renderer))
+        {
+            return -1;
+        }
+        if (scene.denoise)
+        {
+            // the checkpoint keeps the unfiltered image
+            renderer.denoise(scene);
+        }
+        if (!writeImage(options.output, renderer.image()))
+        {
+            return -1;
+        }
+        std::cout << "Wrote " << options.output << std::endl;
+        return 0;
+    }
+    
+    if (!options.sequence.empty())
+    {
+        return renderSequence() ? 0 : -1;
+    }
+    
+    Platform::Stopwatch timer;
+    timer.start();
+    PhotonMapper renderer;
+    
+    // a single pass without post processing is written while it renders
+    ImageStream stream;
+    const bool streaming = options.spp == 1 && !options.adaptive && !options.denoise &&
+                           options.timeBudget <= 0.0 && options.crop.x1 <= options.crop.x0 &&
+                           ImageStream::supports(options.output) &&
+                           stream.open(options.output, options.width, options.height);
+    if (streaming)
+    {
+        renderer.setImageStream(&stream);
+    }
+    const int spp = renderFrame(renderer);
+    renderer.setImageStream(NULL);
+    timer.stop();
+    std::cout << "Rendered " << options.scene << " (" << options.width << "x"
+              << options.height << ", " << spp << " spp) in "
+              << timer.elapsedSeconds() << "s" << std::endl;
+    
+    if (streaming ? !stream.close() : !writeImage(options.output, renderer.image()))
+    {
+        return -1;
+    }
+    std::cout << "Wrote " << options.output << std::endl;
+    return 0;
+}
+
+int
+BatchRenderer::renderFrame(PhotonMapper &renderer)
+{
+    int spp = options.spp;
+    if (options.timeBudget > 0.0)
+    {
+        spp = renderer.renderTimed(scene, options.timeBudget, options.minSpp);
+    }
+    else if (options.crop.x1 > options.crop.x0)
+    {
+        if (scene.photonMap == NULL && scene.specularPhotonMap == NULL)
+        {
+            scene.emit_scatterPhotons();
+        }
+        renderer.renderTile(scene, options.crop, options.spp);
+    }
+    else if (options.adaptive)
+    {
+        scene.adaptiveSamplesPerPixel = options.spp;
+        renderer.renderAdaptive(scene);
+    }
+    else if (options.spp == 1)
+    {
+        // denoises by itself
+        renderer.render(scene);
+        return spp;
+    }
+    else
+    {
+        renderer.resetAccumulation();
+        for (int pass=0; pass<options.spp; pass++)
+        {
+            renderer.renderPass(scene);
+        }
+    }
+    if (scene.denoise)
+    {
+        renderer.denoise(scene);
+    }
+    return spp;
+}
+
+std::string
+BatchRenderer::frameFilename(int frame) const
+{
+    char number[32];
+    const std::string &pattern = options.output;
+    if (pattern.find('%') != std::string::npos)
+    {
+        // printf style pattern, e.g. frame%04d.ppm
+        std::vector<char> name(pattern.size()+32);
+        snprintf(&name[0], name.size(), pattern.c_str(), frame);
+        return std::string(&name[0]);
+    }
+    snprintf(number, sizeof(number), "_%04d", frame);
+    size_t dot = pattern.rfind('.');
+    if (dot == std::string::npos || pattern.find('/', dot) != std::string::npos)
+    {
+        return pattern+number;
+    }
+    return pattern.substr(0, dot)+number+pattern.substr(dot);
+}
+
+bool
+BatchRenderer::renderSequence()
+{
+    CameraPath path;
+    if (!path.load(options.sequence))
+    {
+        return false;
+    }
+    
+    // Only the camera moves: the BBHs were built by the scene loader and
+    // the photon maps are traced by the first frame, both are reused for
+    // every other frame.
+    Platform::Stopwatch total;
+    total.start();
+    PhotonMapper renderer;
+    
+    // frame n is written by a second thread while frame n+1 renders
+    Util::Array2D<Math::Color4f> pending;
+    std::string pendingName;
+    std::thread writer;
+    bool written = true;
+    
+    const int frames = path.frames();
+    for (int frame=0; frame<frames; frame++)
+    {
+        Platform::Stopwatch timer;
+        timer.start();
+        path.apply(scene.camera, frame);
+        const int spp = renderFrame(renderer);
+        timer.stop();
+        std::cout << "Frame " << frame+1 << "/" << frames << " rendered in "
+                  << timer.elapsedSeconds() << "s (" << spp << " spp)" << std::endl;
+        
+        if (writer.joinable())
+        {
+            writer.join();
+        }
+        if (!written)
+        {
+            return false;
+        }
+        const Util::Array2D<Math::Color4f> &image = renderer.image();
+        pending.resizeErase(image.sizeX(), image.sizeY());
+        for (int j=0; j<image.sizeY(); j++)
+        {
+            for (int i=0; i<image.sizeX(); i++)
+            {
+                pending(i, j) = image(i, j);
+            }
+        }
+        pendingName = frameFilename(frame);
+        writer = std::thread([&]() {
+            written = writeImage(pendingName, pending);
+            if (written)
+            {
+                std::cout << "Wrote " << pendingName << std::endl;
+            }
+        });
+    }
+    if (writer.joinable())
+    {
+        writer.join();
+    }
+    total.stop();
+    std::cout << "Rendered " << frames << " frames of " << options.scene << " in "
+              << total.elapsedSeconds() << "s" << std::endl;
+    return written;
+}
@@ -0,0 +1,78 @@
+//
+//  BatchRenderer.h
+//  RaytracerV3
+//
+
+#ifndef __RaytracerV3__BatchRenderer__
+#define __RaytracerV3__BatchRenderer__
+
+#include <string>
+#include "Scene.h"
+#include "SceneLoader.h"
+#include "Util/Array2D.h"
+#include "TileScheduler.h"
+class PhotonMapper;
+
+namespace Main {
+
+    struct BatchOptions
+    {
+        std::string scene;      // name for SceneLoader::loadScene
+        int width;
+        int height;
+        int spp;                // camera samples per pixel
+        int gatherSamples;      // final gather samples, <0: scene default
+        int threads;            // 0: all cores
+        bool adaptive;          // spp is the average adaptive budget
+        double threshold;       // adaptive error threshold, <0: scene default
+        std::string output;
+        TileScheduler::Tile crop;   // pixels to trace, row 0 at the bottom,
+                                    // empty: the whole image
+        std::string sequence;   // camera keyframes, see CameraPath.h
+        double timeBudget;      // seconds per frame, <=0: render spp samples
+        int minSpp;             // samples per pixel despite the time budget
+        bool denoise;           // run the Denoiser on the final image
+        
+        // Distributed rendering, see DistributedRenderer.h
+        int coordinatorPort;    // >=0: serve tiles on this port (0: any)
+        std::string workerAddress;  // HOST:PORT: run as a worker
+        int spawnWorkers;       // local workers started by the coordinator
+        std::string photonFile; // photon maps shared with the workers
+        std::string program;    // argv[0], to spawn workers
+        
+        // Checkpointing, see RenderCheckpoint.h
+        std::string checkpoint; // checkpoint file, empty: none
+        double checkpointInterval;  // seconds between checkpoints
+        bool resume;            // continue from the checkpoint
+        uint64_t seed;          // random seed
+        bool hasSeed;           // false: Scene default
+        SamplerType sampler;    // see Sampler.h
+        PhotonIndex photonIndex;    // index of the photon maps
+        float gridCellSize;     // HASH_GRID cell size, <=0: search radius
+        
+        BatchOptions();
+    };
+    
+    // Renders a single frame without a window or an OpenGL context and
+    // writes it to disk.
+    class BatchRenderer
+    {
+        BatchOptions options;
+        Scene scene;
+        SceneLoader sceneLoader;
+        bool valid;
+        
+        bool parseArguments(int argc, const char *argv[]);
+        bool renderCheckpointed(PhotonMapper &renderer);
+        int renderFrame(PhotonMapper &renderer);   // returns the spp
+        bool renderSequence();
+        std::string frameFilename(int frame) const;
+    public:
+        BatchRenderer(int argc, const char *argv[]);
+        int run();
+        
+        static void printUsage(const char *program);
+    };
+    
+};
+#endif /* defined(__RaytracerV3__BatchRenderer__) */
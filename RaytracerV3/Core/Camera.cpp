@@ -1,5 +1,7 @@
 #include "Camera.h"
+#ifndef RAYTRACER_HEADLESS
 #include "MathGL.h"
+#endif
 #include <iostream>
 
 using namespace Math;
@@ -124,6 +126,7 @@ Camera::setCameraToWorld(const Mat44d & c2w)
 void
 Camera::renderGL() const
 {
+#ifndef RAYTRACER_HEADLESS
     // Set perspective projection
     glMatrixMode(GL_PROJECTION);
 	glLoadMatrix(m_perspective);
@@ -131,6 +134,7 @@ Camera::renderGL() const
     // Place the camera
     glMatrixMode(GL_MODELVIEW);
     glLoadMatrix(m_worldToCamera);
+#endif
 }
 
 
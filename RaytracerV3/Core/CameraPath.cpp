@@ -0,0 +1,95 @@
+//
+//  CameraPath.cpp
+//  RaytracerV3
+//
+
+#include "CameraPath.h"
+#include "Camera.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+bool
+CameraPath::load(const std::string &filename)
+{
+    std::ifstream file(filename.c_str());
+    if (!file)
+    {
+        std::cerr << "Could not open camera path " << filename << std::endl;
+        return false;
+    }
+    
+    m_keyframes.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+        
+        std::istringstream in(line);
+        Keyframe k;
+        if (!(in >> k.frame
+                 >> k.eye.x >> k.eye.y >> k.eye.z
+                 >> k.center.x >> k.center.y >> k.center.z
+                 >> k.up.x >> k.up.y >> k.up.z))
+        {
+            std::cerr << filename << ":" << lineNumber << ": invalid keyframe" << std::endl;
+            return false;
+        }
+        if (k.frame < 0 || (!m_keyframes.empty() && k.frame <= m_keyframes.back().frame))
+        {
+            std::cerr << filename << ":" << lineNumber << ": frames must increase" << std::endl;
+            return false;
+        }
+        m_keyframes.push_back(k);
+    }
+    
+    if (m_keyframes.empty())
+    {
+        std::cerr << "No keyframes in " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int
+CameraPath::frames() const
+{
+    return m_keyframes.empty() ? 0 : m_keyframes.back().frame+1;
+}
+
+void
+CameraPath::apply(Camera &camera, int frame) const
+{
+    if (m_keyframes.empty())
+    {
+        return;
+    }
+    
+    // the frames before the first keyframe hold it
+    size_t next = 0;
+    while (next < m_keyframes.size() && m_keyframes[next].frame < frame)
+    {
+        next++;
+    }
+    if (next == 0 || next == m_keyframes.size())
+    {
+        const Keyframe &k = m_keyframes[next == 0 ? 0 : next-1];
+        camera.updateCameraPos(k.eye, k.center, k.up);
+        return;
+    }
+    
+    const Keyframe &a = m_keyframes[next-1];
+    const Keyframe &b = m_keyframes[next];
+    const double t = double(frame-a.frame)/double(b.frame-a.frame);
+    Math::Vec3d up = a.up*(1.0-t)+b.up*t;
+    up.normalize();
+    camera.updateCameraPos(a.eye*(1.0-t)+b.eye*t,
+                           a.center*(1.0-t)+b.center*t,
+                           up);
+}
@@ -0,0 +1,46 @@
+//
+//  CameraPath.h
+//  RaytracerV3
+//
+
+#ifndef __RaytracerV3__CameraPath__
+#define __RaytracerV3__CameraPath__
+
+#include <string>
+#include <vector>
+#include "Math/Vec3.h"
+
+class Camera;
+
+// Camera keyframes for an animation. The file has one keyframe per line:
+//
+//   frame  eye.x eye.y eye.z  center.x center.y center.z  up.x up.y up.z
+//
+// in increasing frame order, '#' starts a comment. The frames in between
+// are interpolated linearly.
+class CameraPath
+{
+public:
+    struct Keyframe
+    {
+        int frame;
+        Math::Vec3d eye;
+        Math::Vec3d center;
+        Math::Vec3d up;
+    };
+    
+    bool load(const std::string &filename);
+    
+    // Number of frames, the first is frame 0
+    int frames() const;
+    
+    // Moves the camera to its position at frame
+    void apply(Camera &camera, int frame) const;
+    
+    const std::vector<Keyframe>& keyframes() const {return m_keyframes;}
+    
+private:
+    std::vector<Keyframe> m_keyframes;
+};
+
+#endif /* defined(__RaytracerV3__CameraPath__) */
@@ -0,0 +1,150 @@
+//
+//  Denoiser.cpp
+//  RaytracerV3
+//
+
+#include "Denoiser.h"
+#include "Scene.h"
+#include "Shape.h"
+#include "SurfaceShader.h"
+#include "TileScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+// below this albedo the illumination is filtered as it is
+static const float g_minAlbedo = 0.01f;
+
+static inline Math::Color3f
+demodulationFactor(const Math::Color3f &albedo)
+{
+    return Math::Color3f(albedo.x > g_minAlbedo ? albedo.x : 1.0f,
+                         albedo.y > g_minAlbedo ? albedo.y : 1.0f,
+                         albedo.z > g_minAlbedo ? albedo.z : 1.0f);
+}
+
+Denoiser::Denoiser():
+    iterations(5),
+    sigmaColor(0.5f),
+    sigmaNormal(0.1f),
+    sigmaDepth(0.02f),
+    sigmaAlbedo(0.1f)
+{
+    
+}
+
+void
+Denoiser::captureFeatures(const Scene &scene)
+{
+    const int xRes = scene.camera.xRes();
+    const int yRes = scene.camera.yRes();
+    m_features.resizeErase(xRes, yRes);
+    
+    TileScheduler scheduler(xRes, yRes, scene.tileSize, scene.renderThreads);
+    scheduler.run([&](const TileScheduler::Tile &tile) {
+        for (int j=tile.y0; j<tile.y1; j++) {
+            for (int i=tile.x0; i<tile.x1; i++) {
+                Feature &f = m_features(i, j);
+                f.valid = false;
+                
+                Ray r = Ray();
+                scene.camera.generateRay(r, i, j);
+                Shape *s_hit = scene.intersect(r);
+                if (s_hit == NULL || s_hit->surfaceShader == NULL || s_hit->areaLight()) {
+                    continue;
+                }
+                s_hit->fillHitInfo(r);
+                f.normal = Math::Vec3f(r.hit.N.x, r.hit.N.y, r.hit.N.z);
+                f.depth = float(r.hit.t);
+                f.albedo = r.hit.surfaceShader->albedo();
+                f.valid = true;
+            }
+        }
+    });
+}
+
+void
+Denoiser::filter(Util::Array2D<Math::Color4f> &image, int threads) const
+{
+    const int xRes = m_features.sizeX();
+    const int yRes = m_features.sizeY();
+    if (image.sizeX() != xRes || image.sizeY() != yRes) {
+        std::cerr << "Denoiser::filter: features do not match the image" << std::endl;
+        return;
+    }
+    
+    // filter the illumination, ping-ponging between two buffers
+    Util::Array2D<Math::Color3f> buffer[2];
+    buffer[0].resizeErase(xRes, yRes);
+    buffer[1].resizeErase(xRes, yRes);
+    for (int j=0; j<yRes; j++) {
+        for (int i=0; i<xRes; i++) {
+            const Math::Color4f &c = image(i, j);
+            buffer[0](i, j) = Math::Color3f(c.x, c.y, c.z)/demodulationFactor(m_features(i, j).albedo);
+        }
+    }
+    
+    static const float kernel[5] = {1.0f/16.0f, 1.0f/4.0f, 3.0f/8.0f, 1.0f/4.0f, 1.0f/16.0f};
+    const float invNormal = 1.0f/(sigmaNormal*sigmaNormal);
+    const float invAlbedo = 1.0f/(sigmaAlbedo*sigmaAlbedo);
+    int src = 0;
+    for (int it=0; it<iterations; it++) {
+        const int step = 1 << it;
+        const float sigmaC = sigmaColor/float(step);
+        const float invColor = 1.0f/(sigmaC*sigmaC);
+        const float invDepth = 1.0f/(sigmaDepth*step*sigmaDepth*step);
+        const Util::Array2D<Math::Color3f> &in = buffer[src];
+        Util::Array2D<Math::Color3f> &out = buffer[1-src];
+        
+        TileScheduler scheduler(xRes, yRes, 32, threads);
+        scheduler.run([&](const TileScheduler::Tile &tile) {
+            for (int j=tile.y0; j<tile.y1; j++) {
+                for (int i=tile.x0; i<tile.x1; i++) {
+                    const Feature &fp = m_features(i, j);
+                    const Math::Color3f &cp = in(i, j);
+                    if (!fp.valid) {
+                        out(i, j) = cp;
+                        continue;
+                    }
+                    
+                    Math::Color3f sum(0.0f);
+                    float weights = 0.0f;
+                    for (int dy=-2; dy<=2; dy++) {
+                        const int y = j+dy*step;
+                        if (y < 0 || y >= yRes)
+                            continue;
+                        for (int dx=-2; dx<=2; dx++) {
+                            const int x = i+dx*step;
+                            if (x < 0 || x >= xRes)
+                                continue;
+                            const Feature &fq = m_features(x, y);
+                            if (!fq.valid)
+                                continue;
+                            const Math::Color3f &cq = in(x, y);
+                            
+                            const Math::Color3f dc = cp-cq;
+                            const Math::Vec3f dn = fp.normal-fq.normal;
+                            const float dz = (fp.depth-fq.depth)/std::max(fp.depth, 1e-6f);
+                            const Math::Color3f da = fp.albedo-fq.albedo;
+                            const float e = dc.dot(dc)*invColor
+                                          + dn.dot(dn)*invNormal
+                                          + dz*dz*invDepth
+                                          + da.dot(da)*invAlbedo;
+                            const float w = kernel[dx+2]*kernel[dy+2]*std::exp(-e);
+                            sum += cq*w;
+                            weights += w;
+                        }
+                    }
+                    out(i, j) = weights > 0.0f ? sum/weights : cp;
+                }
+            }
+        });
+        src = 1-src;
+    }
+    
+    for (int j=0; j<yRes; j++) {
+        for (int i=0; i<xRes; i++) {
+            const Math::Color3f c = buffer[src](i, j)*demodulationFactor(m_features(i, j).albedo);
+            image(i, j) = Math::Color4f(c.x, c.y, c.z, image(i, j).w);
+        }
+    }
+}
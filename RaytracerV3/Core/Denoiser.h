@@ -0,0 +1,51 @@
+//
+//  Denoiser.h
+//  RaytracerV3
+//
+
+#ifndef __RaytracerV3__Denoiser__
+#define __RaytracerV3__Denoiser__
+
+#include "Math/Color.h"
+#include "Math/Vec3.h"
+#include "Util/Array2D.h"
+
+class Scene;
+
+// Edge avoiding a-trous wavelet filter (Dammertz et al. 2010). Every
+// iteration applies a 5x5 B3 spline kernel whose taps are 2^i pixels
+// apart, so a few iterations cover a large footprint. The weights of
+// the taps fall off with the differences of the colour, the normal, the
+// depth and the albedo of the primary hit. The illumination is filtered
+// with the albedo divided out, so that textures stay sharp.
+class Denoiser
+{
+public:
+    // Features of the first surface seen through a pixel
+    struct Feature
+    {
+        Math::Vec3f normal;
+        float depth;
+        Math::Color3f albedo;
+        bool valid;             // false: background or a light, not filtered
+    };
+    
+    Denoiser();
+    
+    // Traces one ray through the center of every pixel
+    void captureFeatures(const Scene &scene);
+    
+    // Filters image (of the size of the captured features) in place
+    void filter(Util::Array2D<Math::Color4f> &image, int threads = 0) const;
+    
+    int iterations;
+    float sigmaColor;       // halved after every iteration
+    float sigmaNormal;
+    float sigmaDepth;       // relative to the depth, per pixel of tap distance
+    float sigmaAlbedo;
+    
+private:
+    Util::Array2D<Feature> m_features;
+};
+
+#endif /* defined(__RaytracerV3__Denoiser__) */
@@ -34,11 +34,12 @@ EmptyShader::shade(const Renderer *render,
     return Math::Color3f(0,0,0);
 }
 
-void
-EmptyShader::processPhoton(EmittedPhoton photon,
+bool
+EmptyShader::processPhoton(const HitInfo & hit,
+                           EmittedPhoton &photon,
                            PhotonMap &photonMap,
                            PhotonMap &specularPhotonMap,
                            const Scene &scene) const
 {
-    return;
+    return false;
 }
\ No newline at end of file
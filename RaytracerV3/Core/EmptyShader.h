@@ -26,7 +26,8 @@ public:
                                 const Scene &scene,
                                 bool gather) const;
     
-    virtual void processPhoton(EmittedPhoton photon,
+    virtual bool processPhoton(const HitInfo & hit,
+                               EmittedPhoton &photon,
                                PhotonMap &photonMap,
                                PhotonMap &specularPhotonMap,
                                const Scene &scene) const;
@@ -12,6 +12,7 @@ class SurfaceShader;
 #include "Color.h"
 #include "Vec2.h"
 #include "Vec3.h"
+#include "Frame.h"
 
 //! Contains information about a ray hit with a surface.
 /*!
@@ -34,6 +35,7 @@ public:
     Math::Vec2d uv;						//!< Texture coordinates
     Math::Vec3d N;						//!< Shading normal vector.
     Math::Vec3d Ng;						//!< Geometric normal vector.
+    Math::Frame frame;                  //!< Shading frame, frame.n is N
     
     Math::Vec3d O;                      //!< Hit Origin
 
@@ -48,7 +50,7 @@ public:
                      const Math::Vec3d& N = Math::Vec3d(0, 1, 0),
                      const Math::Vec3d& Ng = Math::Vec3d(0, 1, 0)) :
         shape(0), surfaceShader(sShader),
-        t(t), P(P), uv(uv), N(N), Ng(Ng),
+        t(t), P(P), uv(uv), N(N), Ng(Ng), frame(N),
         dPdu(0.0f), dPdv(0.0f), dNdu(0.0f), dNdv(0.0f)
     {
         // empty
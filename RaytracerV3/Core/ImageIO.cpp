@@ -0,0 +1,375 @@
+//
+//  ImageIO.cpp
+//  RaytracerV3
+//
+
+#include "ImageIO.h"
+#include "Math/RGBE.h"
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+    inline unsigned char
+    toByte(float v)
+    {
+        v = std::min(std::max(v, 0.0f), 1.0f);
+        return (unsigned char)(v*255.0f+0.5f);
+    }
+    
+    std::string
+    extension(const std::string &filename)
+    {
+        size_t dot = filename.find_last_of('.');
+        if (dot == std::string::npos)
+            return "";
+        std::string ext = filename.substr(dot+1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext;
+    }
+    
+    // Run length encodes one component of a scanline (Greg Ward's new
+    // RLE scheme): a byte >128 is followed by a value repeated byte-128
+    // times, a byte <=128 by that many literal values.
+    void
+    encodeRLE(std::vector<unsigned char> &out, const unsigned char *data, int n)
+    {
+        const int minRun = 4;
+        int i = 0;
+        while (i < n)
+        {
+            // find the next run of at least minRun equal values
+            int runStart = i;
+            int runLength = 0;
+            while (runStart < n)
+            {
+                runLength = 1;
+                while (runLength < 127 && runStart+runLength < n &&
+                       data[runStart+runLength] == data[runStart])
+                    runLength++;
+                if (runLength >= minRun)
+                    break;
+                runStart += runLength;
+            }
+            if (runLength < minRun)
+                runStart = n;
+            
+            // literals up to the run
+            while (i < runStart)
+            {
+                int count = std::min(runStart-i, 128);
+                out.push_back((unsigned char)count);
+                out.insert(out.end(), data+i, data+i+count);
+                i += count;
+            }
+            if (runStart < n)
+            {
+                out.push_back((unsigned char)(128+runLength));
+                out.push_back(data[runStart]);
+                i = runStart+runLength;
+            }
+        }
+    }
+    
+    void
+    encodeHDRRow(std::vector<unsigned char> &out,
+                 const Util::Array2D<Math::Color4f> &image, int row)
+    {
+        const int width = image.sizeX();
+        std::vector<unsigned char> rgbe(4*width);
+        for (int i=0; i<width; i++)
+        {
+            const Math::Color4f &c = image(i, row);
+            Math::floatToRGBE(&rgbe[4*i], std::max(c.x, 0.0f),
+                              std::max(c.y, 0.0f), std::max(c.z, 0.0f));
+        }
+        out.clear();
+        if (width < 8 || width > 0x7fff)
+        {
+            // RLE is not allowed, write flat pixels
+            out = rgbe;
+            return;
+        }
+        out.push_back(2);
+        out.push_back(2);
+        out.push_back((unsigned char)(width >> 8));
+        out.push_back((unsigned char)(width & 0xff));
+        std::vector<unsigned char> component(width);
+        for (int k=0; k<4; k++)
+        {
+            for (int i=0; i<width; i++)
+                component[i] = rgbe[4*i+k];
+            encodeRLE(out, &component[0], width);
+        }
+    }
+    
+    void
+    encodePFMRow(std::vector<unsigned char> &out,
+                 const Util::Array2D<Math::Color4f> &image, int row)
+    {
+        // the header declares little endian (negative scale)
+        const int width = image.sizeX();
+        out.resize(12*width);
+        for (int i=0; i<width; i++)
+        {
+            const Math::Color4f &c = image(i, row);
+            const float rgb[3] = {c.x, c.y, c.z};
+            for (int k=0; k<3; k++)
+            {
+                uint32_t bits;
+                memcpy(&bits, &rgb[k], 4);
+                for (int b=0; b<4; b++)
+                    out[12*i+4*k+b] = (unsigned char)(bits >> (8*b));
+            }
+        }
+    }
+    
+    void
+    writeHeader(FILE *f, bool hdr, int width, int height)
+    {
+        if (hdr)
+            fprintf(f, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", height, width);
+        else
+            fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
+    }
+    
+    // .hdr files start with the top row, .pfm files with the bottom row
+    inline int
+    imageRow(bool hdr, int fileRow, int height)
+    {
+        return hdr ? height-1-fileRow : fileRow;
+    }
+    
+    bool
+    writeFloatImage(const std::string &filename, bool hdr,
+                    const Util::Array2D<Math::Color4f> &image)
+    {
+        FILE *f = fopen(filename.c_str(), "wb");
+        if (f == NULL)
+        {
+            std::cerr << "writeImage: could not open " << filename << std::endl;
+            return false;
+        }
+        const int width = image.sizeX();
+        const int height = image.sizeY();
+        writeHeader(f, hdr, width, height);
+        
+        std::vector<unsigned char> data;
+        bool ok = true;
+        for (int k=0; k<height && ok; k++)
+        {
+            const int j = imageRow(hdr, k, height);
+            if (hdr)
+                encodeHDRRow(data, image, j);
+            else
+                encodePFMRow(data, image, j);
+            ok = fwrite(&data[0], 1, data.size(), f) == data.size();
+        }
+        fclose(f);
+        if (!ok)
+        {
+            std::cerr << "writeImage: could not write " << filename << std::endl;
+        }
+        return ok;
+    }
+}
+
+bool
+writePPM(const std::string &filename,
+         const Util::Array2D<Math::Color4f> &image)
+{
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (f == NULL)
+    {
+        std::cerr << "writePPM: could not open " << filename << std::endl;
+        return false;
+    }
+    
+    const int width = image.sizeX();
+    const int height = image.sizeY();
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    
+    std::vector<unsigned char> row(3*width);
+    bool ok = true;
+    for (int j=height-1; j>=0 && ok; j--)
+    {
+        for (int i=0; i<width; i++)
+        {
+            const Math::Color4f &c = image(i, j);
+            row[3*i+0] = toByte(c.x);
+            row[3*i+1] = toByte(c.y);
+            row[3*i+2] = toByte(c.z);
+        }
+        ok = fwrite(&row[0], 1, row.size(), f) == row.size();
+    }
+    fclose(f);
+    
+    if (!ok)
+    {
+        std::cerr << "writePPM: could not write " << filename << std::endl;
+    }
+    return ok;
+}
+
+bool
+writeHDR(const std::string &filename,
+         const Util::Array2D<Math::Color4f> &image)
+{
+    return writeFloatImage(filename, true, image);
+}
+
+bool
+writePFM(const std::string &filename,
+         const Util::Array2D<Math::Color4f> &image)
+{
+    return writeFloatImage(filename, false, image);
+}
+
+bool
+writeImage(const std::string &filename,
+           const Util::Array2D<Math::Color4f> &image)
+{
+    const std::string ext = extension(filename);
+    if (ext == "ppm")
+    {
+        return writePPM(filename, image);
+    }
+    if (ext == "hdr")
+    {
+        return writeHDR(filename, image);
+    }
+    if (ext == "pfm")
+    {
+        return writePFM(filename, image);
+    }
+    std::cerr << "writeImage: unsupported format '" << ext
+              << "' for " << filename << std::endl;
+    return false;
+}
+
+ImageStream::ImageStream():
+    m_file(NULL),
+    m_hdr(false),
+    m_width(0),
+    m_height(0),
+    m_nextRow(0),
+    m_closing(false),
+    m_ok(false)
+{
+    
+}
+
+ImageStream::~ImageStream()
+{
+    close();
+}
+
+bool
+ImageStream::supports(const std::string &filename)
+{
+    const std::string ext = extension(filename);
+    return ext == "hdr" || ext == "pfm";
+}
+
+bool
+ImageStream::open(const std::string &filename, int width, int height)
+{
+    close();
+    if (!supports(filename))
+    {
+        std::cerr << "ImageStream: cannot stream " << filename << std::endl;
+        return false;
+    }
+    m_file = fopen(filename.c_str(), "wb");
+    if (m_file == NULL)
+    {
+        std::cerr << "ImageStream: could not open " << filename << std::endl;
+        return false;
+    }
+    m_filename = filename;
+    m_hdr = extension(filename) == "hdr";
+    m_width = width;
+    m_height = height;
+    m_nextRow = 0;
+    m_closing = false;
+    m_ok = true;
+    writeHeader(m_file, m_hdr, width, height);
+    m_writer = std::thread(&ImageStream::writeRows, this);
+    return true;
+}
+
+void
+ImageStream::addRow(const Util::Array2D<Math::Color4f> &image, int row)
+{
+    std::vector<unsigned char> data;
+    if (m_hdr)
+        encodeHDRRow(data, image, row);
+    else
+        encodePFMRow(data, image, row);
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending[imageRow(m_hdr, row, m_height)].swap(data);
+    m_rowAdded.notify_one();
+}
+
+void
+ImageStream::writeRows()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_nextRow < m_height)
+    {
+        std::map<int, std::vector<unsigned char> >::iterator next = m_pending.find(m_nextRow);
+        if (next == m_pending.end())
+        {
+            if (m_closing)
+                break;
+            m_rowAdded.wait(lock);
+            continue;
+        }
+        
+        std::vector<unsigned char> data;
+        data.swap(next->second);
+        m_pending.erase(next);
+        m_nextRow++;
+        
+        // write without holding the lock
+        lock.unlock();
+        const bool written = fwrite(&data[0], 1, data.size(), m_file) == data.size();
+        lock.lock();
+        m_ok = m_ok && written;
+    }
+}
+
+bool
+ImageStream::close()
+{
+    if (m_file == NULL)
+    {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+        m_rowAdded.notify_one();
+    }
+    m_writer.join();
+    fclose(m_file);
+    m_file = NULL;
+    m_pending.clear();
+    
+    if (m_nextRow < m_height)
+    {
+        std::cerr << "ImageStream: " << m_height-m_nextRow << " rows missing in "
+                  << m_filename << std::endl;
+        m_ok = false;
+    }
+    else if (!m_ok)
+    {
+        std::cerr << "ImageStream: could not write " << m_filename << std::endl;
+    }
+    return m_ok;
+}
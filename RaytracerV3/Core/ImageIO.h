@@ -0,0 +1,79 @@
+//
+//  ImageIO.h
+//  RaytracerV3
+//
+
+#ifndef __RaytracerV3__ImageIO__
+#define __RaytracerV3__ImageIO__
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Math/Color.h"
+#include "Util/Array2D.h"
+
+// Writes the image as binary PPM (P6). Colors are clamped to [0,1] and
+// written as they are displayed in the window, i.e. without gamma.
+// Row 0 of the image is the bottom row, as in the FBO.
+bool writePPM(const std::string &filename,
+              const Util::Array2D<Math::Color4f> &image);
+
+// Writes the unclamped image as Radiance RGBE (.hdr) with run length
+// encoded scanlines.
+bool writeHDR(const std::string &filename,
+              const Util::Array2D<Math::Color4f> &image);
+
+// Writes the unclamped image as little endian Portable Float Map (.pfm).
+bool writePFM(const std::string &filename,
+              const Util::Array2D<Math::Color4f> &image);
+
+// Writes the image in the format given by the file extension
+// (.ppm, .hdr or .pfm)
+bool writeImage(const std::string &filename,
+                const Util::Array2D<Math::Color4f> &image);
+
+// Writes a .hdr or .pfm image while it is being rendered. Rows can be
+// finished in any order: addRow() only copies the row into a queue and a
+// writer thread puts the rows into the file in file order, so the render
+// threads never wait for the disk.
+class ImageStream
+{
+public:
+    ImageStream();
+    ~ImageStream();
+    
+    // True if the format of filename can be streamed
+    static bool supports(const std::string &filename);
+    
+    bool open(const std::string &filename, int width, int height);
+    
+    // Queues row (0 is the bottom) of image, thread safe
+    void addRow(const Util::Array2D<Math::Color4f> &image, int row);
+    
+    // Waits for the writer; false if the file could not be written or
+    // rows are missing
+    bool close();
+    
+private:
+    void writeRows();
+    
+    FILE *m_file;
+    std::string m_filename;
+    bool m_hdr;
+    int m_width;
+    int m_height;
+    
+    std::thread m_writer;
+    std::mutex m_mutex;
+    std::condition_variable m_rowAdded;
+    std::map<int, std::vector<unsigned char> > m_pending;  // by file row
+    int m_nextRow;      // next file row to write
+    bool m_closing;
+    bool m_ok;
+};
+
+#endif /* defined(__RaytracerV3__ImageIO__) */
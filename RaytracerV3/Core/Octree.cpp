@@ -7,26 +7,69 @@
 //
 
 #include "Octree.h"
+#include "Math/Box.h"
+#include "Math/LineAlgo.h"
+#include <algorithm>
+#include <iostream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+    // Spreads the lower 21 bits of v so that there are two zero bits
+    // between each of them.
+    inline uint64_t
+    spreadBits(uint64_t v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+        v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2)  & 0x1249249249249249ULL;
+        return v;
+    }
+
+    inline uint64_t
+    compactBits(uint64_t v)
+    {
+        v &= 0x1249249249249249ULL;
+        v = (v | v >> 2)  & 0x10c30c30c30c30c3ULL;
+        v = (v | v >> 4)  & 0x100f00f00f00f00fULL;
+        v = (v | v >> 8)  & 0x1f0000ff0000ffULL;
+        v = (v | v >> 16) & 0x1f00000000ffffULL;
+        v = (v | v >> 32) & 0x1fffff;
+        return v;
+    }
+
+    inline uint64_t
+    morton(uint64_t x, uint64_t y, uint64_t z)
+    {
+        return (spreadBits(x) << 2) | (spreadBits(y) << 1) | spreadBits(z);
+    }
+
+    typedef std::pair<uint64_t, int> KeyIndex;
+}
 
 Octree::Octree(int maxDepth,
                const Vec3d& bbox_min,
                const Vec3d& bbox_max):
-    maxDepth(maxDepth),
+    maxDepth(std::min(maxDepth, 21)),
     diagonal((bbox_max-bbox_min).length()),
     _bbox_min(bbox_min),
     _bbox_max(bbox_max),
-    root(new OctreeNode(NULL, bbox_min, bbox_max, 0, maxDepth))
+    maxRadius(0.0),
+    leafLevel(0),
+    _built(false)
 {
 }
 
 Octree::~Octree()
 {
     std::cerr << "Octree::Deleting Octree" << std::endl;
-    delete root;
 }
 
-// Warning: We are degenerating the tree here. This function should
-// be used with care... 
 void
 Octree::add(const VolumetricPhoton& photon)
 {
@@ -37,66 +80,166 @@ Octree::add(const VolumetricPhoton& photon)
         std::cerr << "Warning: Point out of bounds, won't insert it here..." << std::endl;
         return;
     }
-    root->add(photon);
+    maxRadius = std::max(maxRadius, photon.radius);
+    _photons.push_back(photon);
+    _built = false;
 }
 
-//void
-//Octree::nearestVertices(std::vector<std::pair<IndexType, Vector3> > &vertices, const Vector3 &p, double radius) const {
-//    if (root == NULL) {
-//        std::cerr << "Octree::nearestVertices: Octree not initialized" << std::endl;
-//    }
-//    root->nearestVertices(vertices, p, radius);
-//}
-//
-//void
-//Octree::nearestVerticesIDX(std::vector<IndexType> &vertices, const Vector3 &p, double radius) const
-//{
-//    if (root == NULL) {
-//        std::cerr << "Octree::nearestVertices: Octree not initialized" << std::endl;
-//    }
-//    root->nearestVerticesIDX(vertices, p, radius);
-////    std::vector<OctreeNode *> queue;
-////    queue.push_back(root);
-////    while (!queue.empty()) {
-////        OctreeNode *cur = queue.back();
-////        queue.pop_back();
-////        
-////        for (OctreeNode *o: cur->childNodes())
-////        {
-////            if (o == NULL) {
-////                continue;
-////            }
-////            if (o->inside(p, radius)) {
-////                if (!(o->empty())) {
-////                    for (const std::pair<IndexType, Vector3>& s: o->getObjects())
-////                    {
-////                        Vector3 &v = s.second;
-////                        if ((p-v).squaredNorm() < r2) {
-////                            vertices.push_back(s.first);
-////                        }
-////                    }
-////                    
-////                }
-////                
-////            }
-////        }
-////    }
-//}
-
-//double
-//Octree::findMinEps(IndexType idx, const Vector3&p, double eps) const
-//{
-//    std::vector<std::pair<IndexType, Vector3> > vertices;
-//    nearestVertices(vertices, p, eps);
-//    for (std::pair<IndexType, Vector3> &s: vertices) {
-//        if (s.first == idx) {
-//            continue;
-//        }
-//        Vector3 &v = s.second;
-//        
-//        double dist = (v-p).norm();
-//        
-//        eps = std::min<double>(eps, dist/2.0);
-//    }
-//    return eps;
-//}
+void
+Octree::build()
+{
+    _nodes.clear();
+    const int n = int(_photons.size());
+
+    // leaves are the first level whose cells are smaller than a photon
+    leafLevel = 0;
+    while (leafLevel < maxDepth && diagonal/double(1 << leafLevel) >= maxRadius)
+        leafLevel++;
+
+    // 1. Morton code of the leaf cell of every photon
+    const Vec3d extent = _bbox_max-_bbox_min;
+    const double cells = double(1 << leafLevel);
+    const uint64_t maxCell = (uint64_t(1) << leafLevel)-1;
+    std::vector<KeyIndex> keys(n);
+#pragma omp parallel for
+    for (int i=0; i<n; i++) {
+        const Vec3d &p = _photons[i].position;
+        uint64_t c[3];
+        for (int a=0; a<3; a++) {
+            double f = extent[a] > 0.0 ? (p[a]-_bbox_min[a])/extent[a] : 0.0;
+            c[a] = std::min(uint64_t(std::max(f*cells, 0.0)), maxCell);
+        }
+        keys[i] = KeyIndex(morton(c[0], c[1], c[2]), i);
+    }
+
+    // 2. Sort chunks in parallel, then merge them pairwise
+    int chunks = 1;
+#ifdef _OPENMP
+    chunks = omp_get_max_threads();
+#endif
+    std::vector<int> bounds(chunks+1);
+    for (int c=0; c<=chunks; c++)
+        bounds[c] = int((long(n)*c)/chunks);
+#pragma omp parallel for
+    for (int c=0; c<chunks; c++)
+        std::sort(keys.begin()+bounds[c], keys.begin()+bounds[c+1]);
+    for (int width=1; width<chunks; width*=2) {
+#pragma omp parallel for
+        for (int c=0; c<chunks-width; c+=2*width) {
+            std::inplace_merge(keys.begin()+bounds[c],
+                               keys.begin()+bounds[c+width],
+                               keys.begin()+bounds[std::min(c+2*width, chunks)]);
+        }
+    }
+
+    std::vector<VolumetricPhoton> sorted(n);
+#pragma omp parallel for
+    for (int i=0; i<n; i++)
+        sorted[i] = _photons[keys[i].second];
+    _photons.swap(sorted);
+
+    // 3. Leaves: one node per distinct key
+    std::vector<std::vector<Node> > levels(leafLevel+1);
+    std::vector<Node> &leaves = levels[leafLevel];
+    for (int i=0; i<n; i++) {
+        if (i == 0 || keys[i].first != keys[i-1].first) {
+            Node node = {keys[i].first, leafLevel, i, i+1, -1, 0};
+            leaves.push_back(node);
+        } else {
+            leaves.back().end = i+1;
+        }
+    }
+
+    // 4. Inner levels, bottom up: siblings are adjacent in Morton order
+    for (int level=leafLevel-1; level>=0; level--) {
+        const std::vector<Node> &children = levels[level+1];
+        std::vector<Node> &parents = levels[level];
+        for (int i=0; i<int(children.size()); i++) {
+            const uint64_t key = children[i].key >> 3;
+            if (i == 0 || key != (children[i-1].key >> 3)) {
+                Node node = {key, level, children[i].begin, children[i].end, i, 1};
+                parents.push_back(node);
+            } else {
+                parents.back().end = children[i].end;
+                parents.back().numChildren++;
+            }
+        }
+    }
+
+    // 5. Concatenate the levels, root first, and rebase the child indices
+    std::vector<int> offset(leafLevel+2, 0);
+    for (int level=0; level<=leafLevel; level++)
+        offset[level+1] = offset[level]+int(levels[level].size());
+    _nodes.resize(offset[leafLevel+1]);
+    for (int level=0; level<=leafLevel; level++) {
+        const int count = int(levels[level].size());
+#pragma omp parallel for
+        for (int i=0; i<count; i++) {
+            Node node = levels[level][i];
+            if (node.firstChild >= 0)
+                node.firstChild += offset[level+1];
+            _nodes[offset[level]+i] = node;
+        }
+    }
+    _built = true;
+
+    std::cout << "Octree: " << n << " photons, " << _nodes.size()
+              << " nodes, leaf level " << leafLevel << std::endl;
+}
+
+void
+Octree::cellBounds(const Node &node, Vec3d &vmin, Vec3d &vmax) const
+{
+    const Vec3d size = (_bbox_max-_bbox_min)/double(1 << node.level);
+    const Vec3d cell(double(compactBits(node.key >> 2)),
+                     double(compactBits(node.key >> 1)),
+                     double(compactBits(node.key)));
+    vmin = Vec3d(_bbox_min.x+cell.x*size.x,
+                 _bbox_min.y+cell.y*size.y,
+                 _bbox_min.z+cell.z*size.z);
+    vmax = vmin+size;
+}
+
+void
+Octree::beamQuery(std::vector<BeamPhoton> &photons,
+                  const Vec3d &o, const Vec3d &d,
+                  double tmin, double tmax) const
+{
+    if (!_built) {
+        std::cerr << "Octree::beamQuery: Octree not built" << std::endl;
+        return;
+    }
+    if (_nodes.empty())
+        return;
+
+    const Vec3d r(maxRadius, maxRadius, maxRadius);
+    int stack[8*21+1];  // depth first, at most 7 siblings pending per level
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node &node = _nodes[stack[--top]];
+
+        // widen the cell by the photon radius
+        Vec3d vmin, vmax;
+        cellBounds(node, vmin, vmax);
+        if (!Math::intersects<Vec3d>(o, d, Math::Box<Vec3d>(vmin-r, vmax+r), tmin, tmax))
+            continue;
+
+        if (node.firstChild >= 0) {
+            for (int c=0; c<node.numChildren; c++)
+                stack[top++] = node.firstChild+c;
+            continue;
+        }
+
+        for (int i=node.begin; i<node.end; i++) {
+            const VolumetricPhoton &s = _photons[i];
+            double t = std::min(std::max((s.position-o).dot(d), tmin), tmax);
+            double r2 = s.radius*s.radius;
+            double dist2 = (s.position-(o+d*t)).length2();
+            if (dist2 >= r2)
+                continue;
+            BeamPhoton b = {&s, t, 2.0*sqrt(r2-dist2)};
+            photons.push_back(b);
+        }
+    }
+}
@@ -14,31 +14,61 @@
 #endif
 
 #include "Math/Vec3.h"
-#include "OctreeNode.h"
 #include "PhotonSource.h"
 #include <vector>
+#include <stdint.h>
 using namespace Math;
+
+// Linear (pointerless) octree. Photons are sorted by the Morton code of
+// their leaf cell, so every node covers a contiguous range of photons and
+// the nodes of each level are stored contiguously, root first. All leaves
+// sit at the same depth, chosen from the largest photon radius.
 class Octree
 {
 public:
     Octree(int maxDepth,
            const Vec3d& bbox_min,
            const Vec3d& bbox_max);
-    
+
     ~Octree();
-    void init(const Vec3d& bbox_min, const Vec3d& bbox_max );
-    
+
     const int maxDepth;
-    
+
+    // Collects a photon, the tree is rebuilt by build()
     void add(const VolumetricPhoton &photon);
-    
+
+    // Sorts the photons and creates the nodes (in parallel)
+    void build();
+
+    // Photons whose sphere intersects the ray segment o+t*d, t in [tmin,tmax]
+    void beamQuery(std::vector<BeamPhoton> &photons,
+                   const Vec3d &o, const Vec3d &d,
+                   double tmin, double tmax) const;
+
+    int size() const {return int(_photons.size());}
+    const std::vector<VolumetricPhoton>& photons() const {return _photons;}
+
 private:
+    struct Node
+    {
+        uint64_t key;       // Morton code of the cell at its level
+        int level;
+        int begin, end;     // photon range
+        int firstChild;     // index of the first child, -1 for leaves
+        int numChildren;
+    };
+
+    void cellBounds(const Node &node, Vec3d &vmin, Vec3d &vmax) const;
+
     const double diagonal;
     const Vec3d _bbox_min;
     const Vec3d _bbox_max;
+    double maxRadius;
+    int leafLevel;
 
-    OctreeNode *root;
-    
+    std::vector<VolumetricPhoton> _photons;
+    std::vector<Node> _nodes;
+    bool _built;
 
 public:
     const Vec3d& getBBoxMin() const
@@ -53,8 +83,6 @@ public:
     {
         return diagonal;
     }
-
-//    double findMinEps(IndexType idx, const Vector3& p, double starteps) const;
 };
 
 #endif /* defined(__ShapeModelling__Octree__) */
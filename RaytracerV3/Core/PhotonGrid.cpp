@@ -0,0 +1,116 @@
+//
+//  PhotonGrid.cpp
+//  RaytracerV3
+//
+
+#include "PhotonGrid.h"
+#include "PhotonMap.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Digits of the radix sort over the bucket hashes
+const int g_radixBits = 8;
+const int g_radixSize = 1 << g_radixBits;
+
+PhotonGrid::PhotonGrid():
+    m_cellSize(1.0f),
+    m_invCellSize(1.0f),
+    m_mask(0)
+{
+    
+}
+
+PhotonGrid::~PhotonGrid()
+{
+    
+}
+
+void
+PhotonGrid::build(const Photon *photons, int first, int last, float cellSize)
+{
+    const int n = last-first+1;
+    m_cellSize = cellSize;
+    m_invCellSize = 1.0f/cellSize;
+    
+    // about two buckets per photon keeps collisions rare
+    unsigned int tableSize = 1;
+    while (tableSize < 2*(unsigned int)(n > 0 ? n : 1))
+        tableSize <<= 1;
+    m_mask = tableSize-1;
+    
+    m_cellStart.assign(tableSize+1, 0);
+    m_indices.resize(n > 0 ? n : 0);
+    if (n <= 0)
+        return;
+    
+    // 1. hash every photon
+    std::vector<unsigned int> keys(n), sortedKeys(n);
+    std::vector<int> sortedIndices(n);
+#pragma omp parallel for
+    for (int i=0; i<n; i++) {
+        int c[3];
+        cellCoord(photons[first+i].pos, c);
+        keys[i] = hash(c[0], c[1], c[2]);
+        m_indices[i] = first+i;
+    }
+    
+    // 2. sort the photon indices by hash, g_radixBits per pass. Each pass
+    // is a stable counting sort: every chunk counts its digits, and a
+    // prefix sum in (digit, chunk) order gives each chunk its own output
+    // ranges. No atomics are needed, and the photons of a bucket always
+    // keep their order in the map.
+#ifdef _OPENMP
+    const int chunks = std::min(omp_get_max_threads(), n);
+#else
+    const int chunks = 1;
+#endif
+    int bits = 0;
+    while ((1u << bits) < tableSize)
+        bits++;
+    std::vector<int> counts(chunks*g_radixSize);
+    for (int shift=0; shift<bits; shift+=g_radixBits) {
+#pragma omp parallel for schedule(static, 1)
+        for (int c=0; c<chunks; c++) {
+            int *count = &counts[c*g_radixSize];
+            std::fill(count, count+g_radixSize, 0);
+            for (int i=int((long long)n*c/chunks); i<int((long long)n*(c+1)/chunks); i++)
+                count[(keys[i] >> shift) & (g_radixSize-1)]++;
+        }
+        
+        int sum = 0;
+        for (int d=0; d<g_radixSize; d++)
+            for (int c=0; c<chunks; c++) {
+                const int count = counts[c*g_radixSize+d];
+                counts[c*g_radixSize+d] = sum;
+                sum += count;
+            }
+        
+#pragma omp parallel for schedule(static, 1)
+        for (int c=0; c<chunks; c++) {
+            int *offset = &counts[c*g_radixSize];
+            for (int i=int((long long)n*c/chunks); i<int((long long)n*(c+1)/chunks); i++) {
+                const int k = offset[(keys[i] >> shift) & (g_radixSize-1)]++;
+                sortedKeys[k] = keys[i];
+                sortedIndices[k] = m_indices[i];
+            }
+        }
+        keys.swap(sortedKeys);
+        m_indices.swap(sortedIndices);
+    }
+    
+    // 3. the first photon of every bucket, empty buckets start where the
+    // next one does
+    std::fill(m_cellStart.begin(), m_cellStart.end()-1, -1);
+    m_cellStart[tableSize] = n;
+#pragma omp parallel for
+    for (int k=0; k<n; k++) {
+        if (k == 0 || keys[k] != keys[k-1])
+            m_cellStart[keys[k]] = k;
+    }
+    for (unsigned int h=tableSize; h-- > 0; ) {
+        if (m_cellStart[h] < 0)
+            m_cellStart[h] = m_cellStart[h+1];
+    }
+}
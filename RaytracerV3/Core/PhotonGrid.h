@@ -0,0 +1,62 @@
+//
+//  PhotonGrid.h
+//  RaytracerV3
+//
+
+#ifndef __RaytracerV3__PhotonGrid__
+#define __RaytracerV3__PhotonGrid__
+
+#include <vector>
+#include <math.h>
+
+struct Photon;
+
+// Uniform grid over the photons of a PhotonMap, addressed through a
+// spatial hash (Teschner et al. 2003). The photon indices are sorted
+// by cell hash with a parallel radix sort, so that all photons of a hash
+// bucket are contiguous and in the order of the photon map. Meant for fixed-radius queries with a radius
+// close to the cell size.
+class PhotonGrid
+{
+public:
+    PhotonGrid();
+    ~PhotonGrid();
+    
+    // Indexes photons[first..last] using cells of the given size.
+    void build(const Photon *photons, int first, int last, float cellSize);
+    
+    float cellSize() const {return m_cellSize;}
+    
+    void cellCoord(const float pos[3], int c[3]) const
+    {
+        c[0] = int(floorf(pos[0]*m_invCellSize));
+        c[1] = int(floorf(pos[1]*m_invCellSize));
+        c[2] = int(floorf(pos[2]*m_invCellSize));
+    }
+    
+    unsigned int hash(int x, int y, int z) const
+    {
+        return ((unsigned int)x*73856093u ^
+                (unsigned int)y*19349663u ^
+                (unsigned int)z*83492791u) & m_mask;
+    }
+    
+    unsigned int buckets() const {return m_mask+1;}
+    
+    // Range of the bucket h in the sorted index array
+    int begin(unsigned int h) const {return m_cellStart[h];}
+    int end(unsigned int h) const {return m_cellStart[h+1];}
+    
+    // Index into the photon array of the PhotonMap
+    int photon(int k) const {return m_indices[k];}
+    
+private:
+    float m_cellSize;
+    float m_invCellSize;
+    unsigned int m_mask;
+    
+    std::vector<int> m_cellStart;
+    std::vector<int> m_indices;
+};
+
+#endif /* defined(__RaytracerV3__PhotonGrid__) */
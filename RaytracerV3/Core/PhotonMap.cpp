@@ -29,6 +29,10 @@ PhotonMap :: PhotonMap( const int max_phot )
     stored_photons = 0;
     prev_scale = 1;
     max_photons = max_phot;
+    dropped_photons = 0;
+    half_stored_photons = 0;
+    index_type = KD_TREE;
+    grid_cell_size = 0.0f;
     
     photons = (Photon*)malloc( sizeof( Photon ) * ( max_photons+1 ) );
     
@@ -74,6 +78,44 @@ void PhotonMap :: photon_dir( float *dir, const Photon *p ) const
 }
 
 
+/* photon_normal returns the surface normal stored with a photon
+ */
+//*********************************************************************
+void PhotonMap :: photon_normal( float *normal, const Photon *p ) const
+//*********************************************************************
+{
+    normal[0] = sintheta[p->ntheta]*cosphi[p->nphi];
+    normal[1] = sintheta[p->ntheta]*sinphi[p->nphi];
+    normal[2] = costheta[p->ntheta];
+}
+
+
+/* encode_dir compresses a unit direction into the
+ * two bytes used by photon_dir and photon_normal
+ */
+//*********************************************
+void PhotonMap :: encode_dir(
+                              unsigned char &theta_out,
+                              unsigned char &phi_out,
+                              const float dir[3] ) const
+//*********************************************
+{
+    int theta = int( acos(dir[2])*(256.0/M_PI) );
+    if (theta>255)
+        theta_out = 255;
+    else
+        theta_out = (unsigned char)theta;
+    
+    int phi = int( atan2(dir[1],dir[0])*(256.0/(2.0*M_PI)) );
+    if (phi>255)
+        phi_out = 255;
+    else if (phi<0)
+        phi_out = (unsigned char)(phi+256);
+    else
+        phi_out = (unsigned char)phi;
+}
+
+
 /* irradiance_estimate computes an irradiance estimate
  * at a given surface position
  */
@@ -88,6 +130,19 @@ void PhotonMap :: irradiance_estimate(
 {
     irrad[0] = irrad[1] = irrad[2] = 0.0;
     
+    // the grid has no k-NN query, estimate over max_dist instead
+    if (index_type == HASH_GRID) {
+        if (fixed_radius_estimate( irrad, pos, normal, max_dist ) < 8) {
+            irrad[0] = irrad[1] = irrad[2] = 0.0;
+            return;
+        }
+        const float tmp=(1.0f/M_PI)/(max_dist*max_dist);
+        irrad[0] *= tmp;
+        irrad[1] *= tmp;
+        irrad[2] *= tmp;
+        return;
+    }
+    
     NearestPhotons np;
     np.dist2 = (float*)alloca( sizeof(float)*(nphotons+1) );
     np.index = (const Photon**)alloca( sizeof(Photon*)*(nphotons+1) );
@@ -128,6 +183,275 @@ void PhotonMap :: irradiance_estimate(
 }
 
 
+/* fixed_radius_estimate sums the power of all photons within
+ * radius of pos that arrived from the front side of the surface.
+ * Unlike irradiance_estimate the result is not normalized; this
+ * is the query progressive photon mapping needs.
+ */
+//**********************************************
+int PhotonMap :: fixed_radius_estimate(
+                                        float flux[3],
+                                        const float pos[3],
+                                        const float normal[3],
+                                        const float radius ) const
+//**********************************************
+{
+    flux[0] = flux[1] = flux[2] = 0.0;
+    int found = 0;
+    
+    if (stored_photons<1)
+        return 0;
+    
+    if (index_type == HASH_GRID)
+        grid_gather( flux, &found, pos, normal, radius );
+    else
+        locate_in_radius( flux, &found, pos, normal, radius*radius, 1 );
+    
+    return found;
+}
+
+
+/* grid_gather visits the grid cells overlapping the query sphere.
+ * Distinct cells may share a hash bucket, so a photon is only
+ * counted from the cell it actually lies in.
+ */
+//******************************************
+void PhotonMap :: grid_gather(
+                               float flux[3],
+                               int *found,
+                               const float pos[3],
+                               const float normal[3],
+                               const float radius ) const
+//******************************************
+{
+    const float radius2 = radius*radius;
+    const float lo[3] = { pos[0]-radius, pos[1]-radius, pos[2]-radius };
+    const float hi[3] = { pos[0]+radius, pos[1]+radius, pos[2]+radius };
+    int cmin[3], cmax[3];
+    grid.cellCoord( lo, cmin );
+    grid.cellCoord( hi, cmax );
+    
+    float pdir[3];
+    int c[3];
+    
+    // radius much larger than the cells: visiting every bucket once is cheaper
+    const double ncells = double(cmax[0]-cmin[0]+1)*double(cmax[1]-cmin[1]+1)*double(cmax[2]-cmin[2]+1);
+    if (ncells > double(grid.buckets())) {
+        for (int k=0; k<grid.end(grid.buckets()-1); k++) {
+            const Photon *p = &photons[grid.photon(k)];
+            float dist1 = p->pos[0] - pos[0];
+            float dist2 = dist1*dist1;
+            dist1 = p->pos[1] - pos[1];
+            dist2 += dist1*dist1;
+            dist1 = p->pos[2] - pos[2];
+            dist2 += dist1*dist1;
+            if ( dist2 >= radius2 )
+                continue;
+            
+            photon_dir( pdir, p );
+            if ( (pdir[0]*normal[0]+pdir[1]*normal[1]+pdir[2]*normal[2]) < 0.0f ) {
+                flux[0] += p->power[0];
+                flux[1] += p->power[1];
+                flux[2] += p->power[2];
+                (*found)++;
+            }
+        }
+        return;
+    }
+    
+    for (int x=cmin[0]; x<=cmax[0]; x++)
+        for (int y=cmin[1]; y<=cmax[1]; y++)
+            for (int z=cmin[2]; z<=cmax[2]; z++) {
+                const unsigned int h = grid.hash( x, y, z );
+                for (int k=grid.begin(h); k<grid.end(h); k++) {
+                    const Photon *p = &photons[grid.photon(k)];
+                    
+                    grid.cellCoord( p->pos, c );
+                    if (c[0] != x || c[1] != y || c[2] != z)
+                        continue;
+                    
+                    float dist1 = p->pos[0] - pos[0];
+                    float dist2 = dist1*dist1;
+                    dist1 = p->pos[1] - pos[1];
+                    dist2 += dist1*dist1;
+                    dist1 = p->pos[2] - pos[2];
+                    dist2 += dist1*dist1;
+                    if ( dist2 >= radius2 )
+                        continue;
+                    
+                    photon_dir( pdir, p );
+                    if ( (pdir[0]*normal[0]+pdir[1]*normal[1]+pdir[2]*normal[2]) < 0.0f ) {
+                        flux[0] += p->power[0];
+                        flux[1] += p->power[1];
+                        flux[2] += p->power[2];
+                        (*found)++;
+                    }
+                }
+            }
+}
+
+
+/* locate_in_radius visits every photon of the kd-tree
+ * within sqrt(radius2) of pos
+ */
+//******************************************
+void PhotonMap :: locate_in_radius(
+                                    float flux[3],
+                                    int *found,
+                                    const float pos[3],
+                                    const float normal[3],
+                                    const float radius2,
+                                    const int index ) const
+//******************************************
+{
+    const Photon *p = &photons[index];
+    float dist1;
+    
+    // unlike locate_photons this visits every node that has children,
+    // so that the result matches an exhaustive search
+    if (2*index<=stored_photons) {
+        const bool has_right = 2*index+1<=stored_photons;
+        dist1 = pos[ p->plane ] - p->pos[ p->plane ];
+        
+        if (dist1>0.0) { // if dist1 is positive search right plane
+            if ( has_right )
+                locate_in_radius( flux, found, pos, normal, radius2, 2*index+1 );
+            if ( dist1*dist1 < radius2 )
+                locate_in_radius( flux, found, pos, normal, radius2, 2*index );
+        } else {         // dist1 is negative search left first
+            locate_in_radius( flux, found, pos, normal, radius2, 2*index );
+            if ( has_right && dist1*dist1 < radius2 )
+                locate_in_radius( flux, found, pos, normal, radius2, 2*index+1 );
+        }
+    }
+    
+    dist1 = p->pos[0] - pos[0];
+    float dist2 = dist1*dist1;
+    dist1 = p->pos[1] - pos[1];
+    dist2 += dist1*dist1;
+    dist1 = p->pos[2] - pos[2];
+    dist2 += dist1*dist1;
+    
+    if ( dist2 < radius2 ) {
+        float pdir[3];
+        photon_dir( pdir, p );
+        if ( (pdir[0]*normal[0]+pdir[1]*normal[1]+pdir[2]*normal[2]) < 0.0f ) {
+            flux[0] += p->power[0];
+            flux[1] += p->power[1];
+            flux[2] += p->power[2];
+            (*found)++;
+        }
+    }
+}
+
+
+/* precompute_irradiance estimates the irradiance at every
+ * stride-th photon (Christensen, "Faster Photon Map Global
+ * Illumination", 1999) and stores the estimates, together
+ * with the photon normals, in irradiance_map. The estimates
+ * are computed in parallel; irradiance_map is balanced on return.
+ * Call this function after balance().
+ */
+//**********************************************
+void PhotonMap :: precompute_irradiance(
+                                         PhotonMap &irradiance_map,
+                                         const int stride,
+                                         const float max_dist,
+                                         const int nphotons ) const
+//**********************************************
+{
+    if (stored_photons<1 || stride<1)
+        return;
+    
+    const int count = (stored_photons+stride-1)/stride;
+    float *irrad = (float*)malloc( sizeof(float)*3*count );
+    float *normals = (float*)malloc( sizeof(float)*3*count );
+    
+    if (irrad == NULL || normals == NULL) {
+        fprintf(stderr,"Out of memory precomputing irradiance\n");
+        exit(-1);
+    }
+    
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int i=0; i<count; i++) {
+        const Photon *p = &photons[1+i*stride];
+        photon_normal( &normals[3*i], p );
+        irradiance_estimate( &irrad[3*i], p->pos, &normals[3*i], max_dist, nphotons );
+    }
+    
+    for (int i=0; i<count; i++) {
+        const Photon *p = &photons[1+i*stride];
+        irradiance_map.store( &irrad[3*i], p->pos, &normals[3*i], &normals[3*i] );
+    }
+    
+    free(irrad);
+    free(normals);
+    
+    irradiance_map.balance();
+}
+
+
+/* irradiance_lookup returns the precomputed irradiance of the
+ * closest photon whose normal agrees with the surface normal.
+ * Only valid on a map filled by precompute_irradiance.
+ * Returns 0 if no such photon was found within max_dist.
+ */
+//**********************************************
+int PhotonMap :: irradiance_lookup(
+                                    float irrad[3],
+                                    const float pos[3],
+                                    const float normal[3],
+                                    const float max_dist ) const
+//**********************************************
+{
+    irrad[0] = irrad[1] = irrad[2] = 0.0;
+    
+    // only the kd-tree supports nearest neighbour lookups
+    if (stored_photons<1 || index_type != KD_TREE)
+        return 0;
+    
+    // a few candidates, so that a photon on a nearby surface
+    // with a different orientation does not hide the right one
+    const int ncandidates = 8;
+    float dist2[ncandidates+1];
+    const Photon *index[ncandidates+1];
+    
+    NearestPhotons np;
+    np.dist2 = dist2;
+    np.index = index;
+    np.pos[0] = pos[0]; np.pos[1] = pos[1]; np.pos[2] = pos[2];
+    np.max = ncandidates;
+    np.found = 0;
+    np.got_heap = 0;
+    np.dist2[0] = max_dist*max_dist;
+    
+    locate_photons( &np, 1 );
+    
+    const Photon *best = NULL;
+    float best_dist2 = 0.0f;
+    float pnormal[3];
+    
+    for (int i=1; i<=np.found; i++) {
+        const Photon *p = np.index[i];
+        photon_normal( pnormal, p );
+        if ( (pnormal[0]*normal[0]+pnormal[1]*normal[1]+pnormal[2]*normal[2]) < 0.9f )
+            continue;
+        if (best == NULL || np.dist2[i] < best_dist2) {
+            best = p;
+            best_dist2 = np.dist2[i];
+        }
+    }
+    
+    if (best == NULL)
+        return 0;
+    
+    irrad[0] = best->power[0];
+    irrad[1] = best->power[1];
+    irrad[2] = best->power[2];
+    return 1;
+}
+
+
 /* locate_photons finds the nearest photons in the
  * photon map given the parameters in np
  */
@@ -232,11 +556,14 @@ void PhotonMap :: locate_photons(
 void PhotonMap :: store(
                          const float power[3],
                          const float pos[3],
-                         const float dir[3] )
+                         const float dir[3],
+                         const float normal[3] )
 //***************************
 {
-    if (stored_photons>=max_photons)
+    if (stored_photons>=max_photons) {
+        dropped_photons++;
         return;
+    }
     
     stored_photons++;
     Photon *const node = &photons[stored_photons];
@@ -252,19 +579,14 @@ void PhotonMap :: store(
         node->power[i] = power[i];
     }
     
-    int theta = int( acos(dir[2])*(256.0/M_PI) );
-    if (theta>255)
-        node->theta = 255;
-    else
-        node->theta = (unsigned char)theta;
+    encode_dir( node->theta, node->phi, dir );
     
-    int phi = int( atan2(dir[1],dir[0])*(256.0/(2.0*M_PI)) );
-    if (phi>255)
-        node->phi = 255;
-    else if (phi<0)
-        node->phi = (unsigned char)(phi+256);
-    else
-        node->phi = (unsigned char)phi;
+    if (normal != NULL) {
+        encode_dir( node->ntheta, node->nphi, normal );
+    } else {
+        const float ndir[3] = { -dir[0], -dir[1], -dir[2] };
+        encode_dir( node->ntheta, node->nphi, ndir );
+    }
 }
 
 
@@ -286,7 +608,24 @@ void PhotonMap :: scale_photon_power( const float scale )
 }
 
 
-/* balance creates a left balanced kd-tree from the flat photon array.
+/* set_index chooses the spatial index that balance() builds.
+ * The HASH_GRID cell size should be about the query radius, the
+ * Scene passes photonGridCellSize or else maxPhotonMapSearchDist.
+ * Only a cell size of 0 derives one from the photon density.
+ */
+//******************************
+void PhotonMap :: set_index(
+                             const PhotonIndex index,
+                             const float cell_size )
+//******************************
+{
+    index_type = index;
+    grid_cell_size = cell_size;
+}
+
+
+/* balance creates a left balanced kd-tree from the flat photon array,
+ * or the hash grid chosen with set_index.
  * This function should be called before the photon map
  * is used for rendering.
  */
@@ -294,6 +633,22 @@ void PhotonMap :: scale_photon_power( const float scale )
 void PhotonMap :: balance(void)
 //******************************
 {
+    if (index_type == HASH_GRID) {
+        float cell_size = grid_cell_size;
+        if (cell_size <= 0.0f && stored_photons>0) {
+            // roughly 8 photons per cell for a uniform volume density
+            float volume = 1.0f;
+            for (int i=0; i<3; i++)
+                volume *= fmaxf( bbox_max[i]-bbox_min[i], 1e-4f );
+            cell_size = 2.0f*cbrtf( volume/stored_photons );
+        }
+        if (cell_size <= 0.0f)
+            cell_size = 1.0f;
+        grid.build( photons, 1, stored_photons, cell_size );
+        half_stored_photons = 0;
+        return;
+    }
+    
     if (stored_photons>1) {
         // allocate two temporary arrays for the balancing procedure
         Photon **pa1 = (Photon**)malloc(sizeof(Photon*)*(stored_photons+1));
@@ -335,6 +690,78 @@ void PhotonMap :: balance(void)
 }
 
 
+/* write saves the balanced photon map in the binary layout of
+ * this build, so that other processes can read it instead of
+ * tracing the photons again.
+ */
+//********************************************
+int PhotonMap :: write( FILE *file ) const
+//********************************************
+{
+    const char magic[4] = {'P','M','A','P'};
+    int header[4] = { stored_photons, half_stored_photons, prev_scale, int(index_type) };
+    
+    if (fwrite( magic, 1, 4, file ) != 4 ||
+        fwrite( header, sizeof(int), 4, file ) != 4 ||
+        fwrite( &grid_cell_size, sizeof(float), 1, file ) != 1 ||
+        fwrite( bbox_min, sizeof(float), 3, file ) != 3 ||
+        fwrite( bbox_max, sizeof(float), 3, file ) != 3)
+        return 0;
+    
+    if (stored_photons>0 &&
+        fwrite( &photons[1], sizeof(Photon), stored_photons, file ) != size_t(stored_photons))
+        return 0;
+    return 1;
+}
+
+
+/* read replaces the photons with a map saved by write. The
+ * kd-tree is stored balanced, a hash grid is rebuilt.
+ */
+//**************************************
+int PhotonMap :: read( FILE *file )
+//**************************************
+{
+    char magic[4];
+    int header[4];
+    
+    if (fread( magic, 1, 4, file ) != 4 || memcmp( magic, "PMAP", 4 ) != 0 ||
+        fread( header, sizeof(int), 4, file ) != 4 ||
+        fread( &grid_cell_size, sizeof(float), 1, file ) != 1 ||
+        fread( bbox_min, sizeof(float), 3, file ) != 3 ||
+        fread( bbox_max, sizeof(float), 3, file ) != 3) {
+        fprintf(stderr,"PhotonMap: invalid photon map file\n");
+        return 0;
+    }
+    
+    if (header[0] > max_photons) {
+        Photon *p = (Photon*)realloc( photons, sizeof( Photon ) * ( header[0]+1 ) );
+        if (p == NULL) {
+            fprintf(stderr,"Out of memory reading photon map\n");
+            return 0;
+        }
+        photons = p;
+        max_photons = header[0];
+    }
+    
+    stored_photons = header[0];
+    half_stored_photons = header[1];
+    prev_scale = header[2];
+    index_type = PhotonIndex(header[3]);
+    
+    if (stored_photons>0 &&
+        fread( &photons[1], sizeof(Photon), stored_photons, file ) != size_t(stored_photons)) {
+        fprintf(stderr,"PhotonMap: truncated photon map file\n");
+        stored_photons = 0;
+        return 0;
+    }
+    
+    if (index_type == HASH_GRID)
+        balance();
+    return 1;
+}
+
+
 #define swap(ph,a,b) { Photon *ph2=ph[a]; ph[a]=ph[b]; ph[b]=ph2; }
 
 // median_split splits the photon array into two separate
@@ -18,11 +18,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include "PhotonGrid.h"
 
 
 /* This is the photon
  * The power is not compressed so the
- * size is 28 bytes
+ * size is 32 bytes (30 bytes + padding)
  */
 //**********************
 typedef struct Photon {
@@ -31,6 +32,7 @@ typedef struct Photon {
     short plane;                  // splitting plane for kd-tree
     unsigned char theta, phi;     // incoming direction
     float power[3];               // photon power (uncompressed)
+    unsigned char ntheta, nphi;   // surface normal at pos
 } Photon;
 
 
@@ -49,6 +51,16 @@ typedef struct NearestPhotons {
 } NearestPhotons;
 
 
+/* Spatial index used for photon lookups. The kd-tree answers
+ * k-nearest neighbour queries, the hash grid only fixed-radius
+ * queries (k-NN queries fall back to max_dist on a grid).
+ */
+enum PhotonIndex {
+    KD_TREE,
+    HASH_GRID
+};
+
+
 /* This is the PhotonMap class
  */
 //*****************
@@ -61,12 +73,20 @@ public:
     void store(
                const float power[3],          // photon power
                const float pos[3],            // photon position
-               const float dir[3] );          // photon direction
+               const float dir[3],            // photon direction
+               const float normal[3] = NULL );// surface normal (default: -dir)
     
     void scale_photon_power(
                             const float scale );           // 1/(number of emitted photons)
     
-    void balance(void);              // balance the kd-tree (before use!)
+    void set_index(
+                   const PhotonIndex index,       // index built by balance()
+                   const float cell_size = 0.0f );// grid cell size, ~ query radius
+    
+    void balance(void);              // build the photon index (before use!)
+    
+    int write( FILE *file ) const;   // save a balanced map; returns 1 on success
+    int read( FILE *file );          // load a map saved by write (same build)
     
     void irradiance_estimate(
                              float irrad[3],                // returned irradiance
@@ -75,6 +95,24 @@ public:
                              const float max_dist,          // max distance to look for photons
                              const int nphotons ) const;    // number of photons to use
     
+    int fixed_radius_estimate(
+                              float flux[3],                 // returned sum of photon power
+                              const float pos[3],            // surface position
+                              const float normal[3],         // surface normal at pos
+                              const float radius ) const;    // gather radius; returns #photons
+    
+    void precompute_irradiance(
+                               PhotonMap &irradiance_map,     // receives the precomputed estimates
+                               const int stride,              // estimate at every stride-th photon
+                               const float max_dist,          // max distance to look for photons
+                               const int nphotons ) const;    // number of photons to use
+    
+    int irradiance_lookup(
+                          float irrad[3],                // returned irradiance
+                          const float pos[3],            // surface position
+                          const float normal[3],         // surface normal at pos
+                          const float max_dist ) const;  // max distance to look for a precomputed photon
+    
     void locate_photons(
                         NearestPhotons *const np,      // np is used to locate the photons
                         const int index ) const;       // call with index = 1
@@ -83,8 +121,35 @@ public:
                     float *dir,                    // direction of photon (returned)
                     const Photon *p ) const;       // the photon
     
+    void photon_normal(
+                       float *normal,                 // surface normal at the photon (returned)
+                       const Photon *p ) const;       // the photon
+    
+    int size() const { return stored_photons; }
+    int dropped() const { return dropped_photons; } // store() calls on a full map
+    
 private:
     
+    void locate_in_radius(
+                          float flux[3],                 // accumulated photon power
+                          int *found,                    // accumulated number of photons
+                          const float pos[3],            // surface position
+                          const float normal[3],         // surface normal at pos
+                          const float radius2,           // squared gather radius
+                          const int index ) const;       // call with index = 1
+    
+    void grid_gather(
+                     float flux[3],                 // accumulated photon power
+                     int *found,                    // accumulated number of photons
+                     const float pos[3],            // surface position
+                     const float normal[3],         // surface normal at pos
+                     const float radius ) const;    // gather radius
+    
+    void encode_dir(
+                    unsigned char &theta,          // returned polar angle
+                    unsigned char &phi,            // returned azimuthal angle
+                    const float dir[3] ) const;    // direction to compress
+    
     void balance_segment(
                          Photon **pbal,
                          Photon **porg,
@@ -104,8 +169,13 @@ private:
     int stored_photons;
     int half_stored_photons;
     int max_photons;
+    int dropped_photons;
     int prev_scale;
     
+    PhotonIndex index_type;
+    float grid_cell_size;
+    PhotonGrid grid;
+    
     float costheta[256];
     float sintheta[256];
     float cosphi[256];
@@ -63,6 +63,12 @@ PhotonSource::getArea() const
     return 1.0;
 }
 
+int
+PhotonSource::emitCausticPhotons(std::vector<EmittedPhoton>& photons, Scene& scene, int count)
+{
+    return 0;
+}
+
 bool
 PhotonSource::areaLight() const
 {
@@ -22,6 +22,25 @@ typedef struct VolumetricPhoton
     Math::Vec3d power;
     double      radius;
 } VolumetricPhoton;
+
+// A volumetric photon found along a ray: t is the ray parameter of the
+// point closest to the photon, chord the length of the ray inside the
+// photon's sphere.
+typedef struct BeamPhoton
+{
+    const VolumetricPhoton *photon;
+    double t;
+    double chord;
+} BeamPhoton;
+// Photon maps an emitted photon may be stored in. Photons from the
+// caustic emission mode only feed the caustic (specular) photon map,
+// the remaining photons of that light only the global one.
+enum PhotonTarget
+{
+    GLOBAL_AND_CAUSTIC = 0,
+    GLOBAL_ONLY,
+    CAUSTIC_ONLY
+};
 typedef struct EmittedPhoton
 {
     Math::Vec3d position;
@@ -29,6 +48,7 @@ typedef struct EmittedPhoton
     Math::Vec3d dir;
     bool        specularBounces;
     bool        indirect;
+    PhotonTarget target;
 } EmittedPhoton;
 
 class PhotonSource
@@ -42,7 +62,13 @@ public:
     const double power;
     const int photons;
     
-    virtual void emitPhotons(std::vector<EmittedPhoton>& photons, Scene& scene) = 0;
+    // Emits count photons, each carrying power/count of the light's power.
+    virtual void emitPhotons(std::vector<EmittedPhoton>& photons, Scene& scene, int count) = 0;
+    
+    // Emits count photons towards specular objects only (projection
+    // maps). Returns the number of emitted photons; 0 if the light does
+    // not support it, its regular photons then keep feeding both maps.
+    virtual int emitCausticPhotons(std::vector<EmittedPhoton>& photons, Scene& scene, int count);
     
     virtual Math::Color3f computeIntensity(const HitInfo &hit, const Scene &scene) const;
     virtual Math::Color3f computeSurfaceIntensity(const HitInfo &hit, const Scene &scene) const;
@@ -9,7 +9,7 @@
 #include "DiffuseSquareAreaLight.h"
 
 #include <assert.h>
-#include "Math/Mat44.h"
+#include "Math/Frame.h"
 #include "Scene.h"
 #include "Mesh.h"
 #include "EmptyShader.h"
@@ -41,15 +41,15 @@ DiffuseSquareAreaLight::~DiffuseSquareAreaLight()
 }
 
 void
-DiffuseSquareAreaLight::emitPhotons(std::vector<EmittedPhoton> &photonEmitter, Scene &scene)
+DiffuseSquareAreaLight::emitPhotons(std::vector<EmittedPhoton> &photonEmitter, Scene &scene, int count)
 {
     std::vector<Math::Vec2d> samples;
-    scene.generateStratifiedJitteredSamples(samples, photons);
+    scene.generateSamples(samples, count);
     std::vector<Math::Vec2d> lightSamples;
-    scene.generateStratifiedJitteredSamples(lightSamples, photons);
+    scene.generateSamples(lightSamples, count);
     const double emittedPhotons = (double) samples.size();
     
-    photonEmitter.reserve(photonEmitter.size()+photons);
+    photonEmitter.reserve(photonEmitter.size()+samples.size());
     float total_color = color.x+color.y+color.z;
     
     Math::Vec3f emittedPower = power/(emittedPhotons*total_color)*color;
@@ -60,10 +60,7 @@ DiffuseSquareAreaLight::emitPhotons(std::vector<EmittedPhoton> &photonEmitter, S
     //
     //    return location+radius*(tr*ret);
     
-    Math::Mat44d tr;
-    tr.makeIdentity();
-    tr.rotateTo(Math::Vec3d(0,0,1), normal);
-    //
+    const Math::Frame frame(normal);
     for (size_t i = 0; i < samples.size(); i++)
     {
         Math::Vec2d uv = samples[i];
@@ -73,10 +70,7 @@ DiffuseSquareAreaLight::emitPhotons(std::vector<EmittedPhoton> &photonEmitter, S
         Math::Vec3d d;
         Math::Warp::uniformHemisphere(&d, lightUV.x, lightUV.y);
         
-        //        Math::Vec3d dir = (tr*d).normalize();
-        //        dir.z = -d.z;
-        Math::Vec3d dir = d;
-        dir.z = -dir.z;
+        Math::Vec3d dir = frame.toWorld(d);
         //        std::cout << d.x << " " << d.y << " " << d.z << std::endl;
         //        std::cout << dir.x << " " << dir.y << " " << dir.z << std::endl;
         
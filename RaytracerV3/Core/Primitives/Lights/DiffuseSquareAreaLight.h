@@ -41,7 +41,7 @@ public:
         return true;
     }
     
-    virtual void emitPhotons(std::vector<EmittedPhoton>& photonEmitter, Scene& scene);
+    virtual void emitPhotons(std::vector<EmittedPhoton>& photonEmitter, Scene& scene, int count);
     
     
 };
@@ -11,11 +11,19 @@
 #include "Math/Vec2.h"
 #include "Warp.h"
 #include "Scene.h"
+#include "Shape.h"
+#include "SurfaceShader.h"
+
+// Resolution of the projection map in s (azimuth) and t (height)
+const int g_projectionMapResS = 128;
+const int g_projectionMapResT = 64;
+
 IsotropicPointLight::IsotropicPointLight(const Math::Vec3d& position,
                                          const Math::Color3f& color,
                                          double power,
                                          int photons):
-PhotonSource(position,color, power, photons)
+PhotonSource(position,color, power, photons),
+m_projectionMapBuilt(false)
 {
     
 }
@@ -26,23 +34,121 @@ IsotropicPointLight::~IsotropicPointLight()
 }
 
 void
-IsotropicPointLight::emitPhotons(std::vector<EmittedPhoton>& photonEmitter, Scene& scene)
+IsotropicPointLight::emitPhotons(std::vector<EmittedPhoton>& photonEmitter, Scene& scene, int count)
 {
     std::vector<Math::Vec2d> samples;
-    scene.generateStratifiedJitteredSamples(samples, photons);
+    scene.generateSamples(samples, count);
     const double sampleSize = samples.size();
-    photonEmitter.reserve(photonEmitter.size()+photons);
+    photonEmitter.reserve(photonEmitter.size()+samples.size());
 
     float total_color = color.x+color.y+color.z;
     Math::Vec3f emittedPower = power/(sampleSize*total_color)*color;
-    for (Math::Vec2d &sample: samples)
+    std::vector<Math::Vec3d> dirs(samples.size());
+    Math::Warp::uniformSphereBatch(dirs.data(), samples.data(), int(samples.size()));
+    for (const Math::Vec3d &dir: dirs)
     {
-        Math::Vec3d dir;
-        Math::Warp::uniformSphere(&dir, sample.x, sample.y);
         photonEmitter.push_back({position, emittedPower, dir, false});
     }
 }
 
+void
+IsotropicPointLight::buildProjectionMap(const Scene& scene)
+{
+    const int resS = g_projectionMapResS;
+    const int resT = g_projectionMapResT;
+    std::vector<bool> specular(resS*resT, false);
+    
+    // a cell is flagged if one of its 2x2 test rays hits a specular object
+    for (int j=0; j<resT; j++)
+    {
+        for (int i=0; i<resS; i++)
+        {
+            for (int k=0; k<4 && !specular[j*resS+i]; k++)
+            {
+                Ray r;
+                r.o = position;
+                r.tMin = 1e-3;
+                Math::Warp::uniformSphere(&r.d,
+                                          (i+0.25+0.5*(k&1))/resS,
+                                          (j+0.25+0.5*(k>>1))/resT);
+                Shape *s_hit = scene.intersect(r);
+                if (s_hit != NULL &&
+                    s_hit->surfaceShader != NULL &&
+                    !s_hit->surfaceShader->diffuse())
+                {
+                    specular[j*resS+i] = true;
+                }
+            }
+        }
+    }
+    
+    // dilate by one cell so that silhouettes missed by the test rays are covered
+    m_causticCells.clear();
+    for (int j=0; j<resT; j++)
+    {
+        for (int i=0; i<resS; i++)
+        {
+            bool flagged = false;
+            for (int dj=-1; dj<=1 && !flagged; dj++)
+            {
+                int nj = j+dj;
+                if (nj < 0 || nj >= resT)
+                    continue;
+                for (int di=-1; di<=1 && !flagged; di++)
+                {
+                    int ni = (i+di+resS)%resS;
+                    flagged = specular[nj*resS+ni];
+                }
+            }
+            if (flagged)
+                m_causticCells.push_back(j*resS+i);
+        }
+    }
+    m_projectionMapBuilt = true;
+    
+    std::cout << "IsotropicPointLight: projection map covers "
+              << 100.0*m_causticCells.size()/double(resS*resT) << "% of the sphere" << std::endl;
+}
+
+int
+IsotropicPointLight::emitCausticPhotons(std::vector<EmittedPhoton>& photonEmitter, Scene& scene, int count)
+{
+    if (!m_projectionMapBuilt)
+    {
+        buildProjectionMap(scene);
+    }
+    if (m_causticCells.empty() || count <= 0)
+    {
+        return 0;
+    }
+    
+    const int resS = g_projectionMapResS;
+    const int resT = g_projectionMapResT;
+    
+    // Every photon represents a solid angle of coverage*4pi/count
+    // instead of 4pi/count, which keeps the caustic map unbiased.
+    const double coverage = m_causticCells.size()/double(resS*resT);
+    float total_color = color.x+color.y+color.z;
+    Math::Vec3f emittedPower = power*coverage/(count*total_color)*color;
+    
+    photonEmitter.reserve(photonEmitter.size()+count);
+    const int ncells = m_causticCells.size();
+    for (int n=0; n<count; n++)
+    {
+        // stratify over the flagged cells, jitter inside the cell
+        int c = std::min(int((n+scene.rng().nextd())*ncells/count), ncells-1);
+        int cell = m_causticCells[c];
+        int i = cell%resS;
+        int j = cell/resS;
+        Math::Vec3d dir;
+        Math::Warp::uniformSphere(&dir,
+                                  (i+scene.rng().nextd())/resS,
+                                  (j+scene.rng().nextd())/resT);
+        photonEmitter.push_back({position, emittedPower, dir, false, false, CAUSTIC_ONLY});
+    }
+    return count;
+}
+
 Math::Color3f
 IsotropicPointLight::computeIntensity(const HitInfo &hit, const Scene &scene) const
 {
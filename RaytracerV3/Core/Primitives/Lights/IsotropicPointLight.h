@@ -12,6 +12,13 @@
 #include "PhotonSource.h"
 class IsotropicPointLight: public PhotonSource
 {
+    // Projection map over the (s,t) domain of Warp::uniformSphere, so
+    // every cell covers the same solid angle. Lists the cells whose
+    // directions hit a specular object.
+    std::vector<int> m_causticCells;
+    bool m_projectionMapBuilt;
+    
+    void buildProjectionMap(const Scene& scene);
 public:
     IsotropicPointLight(const Math::Vec3d& position,
                         const Math::Color3f& color,
@@ -19,7 +26,8 @@ public:
                         int photons);
     ~IsotropicPointLight();
     //    virtual Math::Color3f computeIntensity(const HitInfo &hit, const Scene &scene) const;
-        virtual void emitPhotons(std::vector<EmittedPhoton>& photonEmitter, Scene& scene);
+        virtual void emitPhotons(std::vector<EmittedPhoton>& photonEmitter, Scene& scene, int count);
+        virtual int emitCausticPhotons(std::vector<EmittedPhoton>& photonEmitter, Scene& scene, int count);
 virtual Math::Color3f computeIntensity(const HitInfo &hit, const Scene &scene) const;
 };
 #endif /* defined(__RaytracerV3__IsotropicPointLight__) */
@@ -9,7 +9,9 @@
 #include "Mesh.h"
 #include <iostream>
 #include "Math/MeshBase.h"
+#ifndef RAYTRACER_HEADLESS
 #include "Math/MathGL.h"
+#endif
 #include "Math/Core.h"
 #include "Math/LineAlgo.h"
 
@@ -94,6 +96,7 @@ m_maxObjects(maxObjects)
 void
 Mesh::renderGL(bool wireframe) const
 {
+#ifndef RAYTRACER_HEADLESS
 	if (!m_mesh)
 		return;
     
@@ -117,6 +120,7 @@ Mesh::renderGL(bool wireframe) const
         glPolygonMode(GL_FRONT, GL_FILL);
         glPolygonMode(GL_BACK, GL_FILL);
     }
+#endif
 }
 
 bool
@@ -194,4 +198,5 @@ Mesh::fillHitInfo(Ray * r) const
     r->hit.P = r->o + r->hit.t*r->d;
     r->hit.I = r->d;
     r->hit.O = r->o;
+    r->hit.frame = Math::Frame(r->hit.N);
 }
\ No newline at end of file
@@ -8,8 +8,10 @@
 
 #include "Sphere.h"
 
+#ifndef RAYTRACER_HEADLESS
 #include "OGL/Primitive.h"
 #include "Math/MathGL.h"
+#endif
 #include "Math/Core.h"
 
 using namespace Math;
@@ -25,6 +27,7 @@ radius(rad)
 void
 Sphere::renderGL(bool wireframe) const
 {
+#ifndef RAYTRACER_HEADLESS
 	glPushMatrix();
     glTranslate(location);
     if (wireframe)
@@ -33,6 +36,7 @@ Sphere::renderGL(bool wireframe) const
         glutSolidSphere(radius, 16, 16);
     
 	glPopMatrix();
+#endif
 }
 
 bool
@@ -130,6 +134,7 @@ Sphere::fillHitInfo(Ray & ray) const
     ray.hit.O = ray.o;
     ray.hit.I = (ray.hit.P-ray.o).normalize();
     ray.hit.N = (ray.hit.P - location).normalize();
+    ray.hit.frame = Math::Frame(ray.hit.N);
     ray.hit.surfaceShader = surfaceShader;
 }
 //
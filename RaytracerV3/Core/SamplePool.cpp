@@ -0,0 +1,69 @@
+//
+//  SamplePool.cpp
+//  RaytracerV3
+//
+
+#include "SamplePool.h"
+
+SamplePool::SamplePool():
+    m_N(-1),
+    m_type(STRATIFIED_SAMPLER),
+    m_seed(0),
+    m_count(0)
+{
+}
+
+void
+SamplePool::build(int N, SamplerType type, uint64_t seed)
+{
+    m_N = N;
+    m_type = type;
+    m_seed = seed;
+
+    Math::PCG32 rng;
+    rng.seed(seed, uint64_t(N));
+    const Sampler *sampler = Sampler::get(type);
+    std::vector<Math::Vec2d> set;
+    m_sets.clear();
+    for (int s=0; s<SETS; s++)
+    {
+        if (sampler == NULL)
+        {
+            Sampler::stratified(set, N, rng);
+        }
+        else
+        {
+            sampler->generate(set, N, rng);
+        }
+        m_sets.insert(m_sets.end(), set.begin(), set.end());
+    }
+    m_count = int(set.size());
+    m_rotated.resize(m_count);
+}
+
+const Math::Vec2d*
+SamplePool::rotatedSet(int N, SamplerType type, uint64_t seed,
+                       Math::PCG32 &rng, int &count)
+{
+    if (N != m_N || type != m_type || seed != m_seed)
+    {
+        build(N, type, seed);
+    }
+    count = m_count;
+    if (m_count == 0)
+    {
+        return NULL;
+    }
+
+    const Math::Vec2d *set = &m_sets[(rng.nexti() % SETS)*m_count];
+    const double u = rng.nextd();
+    const double v = rng.nextd();
+    for (int i=0; i<m_count; i++)
+    {
+        double x = set[i].x+u;
+        double y = set[i].y+v;
+        m_rotated[i] = Math::Vec2d(x < 1.0 ? x : x-1.0,
+                                   y < 1.0 ? y : y-1.0);
+    }
+    return &m_rotated[0];
+}
@@ -0,0 +1,45 @@
+//
+//  SamplePool.h
+//  RaytracerV3
+//
+
+#ifndef __RaytracerV3__SamplePool__
+#define __RaytracerV3__SamplePool__
+
+#include <vector>
+#include <stdint.h>
+#include "Math/Vec2.h"
+#include "Math/PCG.h"
+#include "Sampler.h"
+
+// Sample sets for the shading hot path without heap allocations. The pool
+// holds SETS precomputed sets of the scene's sampler; every request picks
+// one of them and shifts it by a random offset modulo 1 (Cranley-Patterson
+// rotation), which keeps the stratification and makes every point
+// uniformly distributed again. Memory is only allocated when the set size
+// or the sampler changes.
+class SamplePool
+{
+public:
+    static const int SETS = 16;
+
+    SamplePool();
+
+    // A rotated set of (at least) N samples, count receives its size. The
+    // samples stay valid until the next call. The precomputed sets only
+    // depend on N, type and seed, so all threads share the same ones.
+    const Math::Vec2d* rotatedSet(int N, SamplerType type, uint64_t seed,
+                                  Math::PCG32 &rng, int &count);
+
+private:
+    void build(int N, SamplerType type, uint64_t seed);
+
+    int m_N;
+    SamplerType m_type;
+    uint64_t m_seed;
+    int m_count;                        // samples per set
+    std::vector<Math::Vec2d> m_sets;    // SETS sets of m_count samples
+    std::vector<Math::Vec2d> m_rotated; // the set handed out
+};
+
+#endif /* defined(__RaytracerV3__SamplePool__) */
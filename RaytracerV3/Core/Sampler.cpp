@@ -0,0 +1,188 @@
+//
+//  Sampler.cpp
+//  RaytracerV3
+//
+
+#include "Sampler.h"
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+    inline uint32_t
+    reverseBits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    // Owen scrambling of a 32 bit fraction, the hash of Laine and Karras
+    // (2011) only lets higher bits flip lower ones once the bits are
+    // reversed (Burley 2020, Practical Hash-based Owen Scrambling).
+    inline uint32_t
+    owenScramble(uint32_t x, uint32_t seed)
+    {
+        x = reverseBits(x);
+        x += seed;
+        x ^= x*0x6c50b47cu;
+        x ^= x*0xb82f1e52u;
+        x ^= x*0xc7afe638u;
+        x ^= x*0x8d22f6e6u;
+        return reverseBits(x);
+    }
+
+    inline double
+    toUnit(uint32_t x)
+    {
+        return x*(1.0/4294967296.0);
+    }
+
+    const SobolSampler g_sobol;
+    const HaltonSampler g_halton;
+}
+
+void
+Sampler::generate(std::vector<Math::Vec2d> &samples, int N,
+                  Math::PCG32 &rng) const
+{
+    const uint64_t scramble = (uint64_t(rng.nexti()) << 32) | rng.nexti();
+    samples.clear();
+    samples.reserve(N);
+    for (int i=0; i<N; i++)
+    {
+        samples.push_back(sample(uint32_t(i), scramble));
+    }
+    // Random order, so that two sets used side by side (e.g. positions
+    // and directions of the light samples) are not correlated
+    for (int i=N-1; i>0; i--)
+    {
+        std::swap(samples[i], samples[rng.nexti()%uint32_t(i+1)]);
+    }
+}
+
+void
+Sampler::stratified(std::vector<Math::Vec2d> &samples, int N,
+                    Math::PCG32 &rng)
+{
+    int n = floor(sqrtf(N));
+    if (N != n*n) {
+        n++;
+        N = n*n;
+#ifdef DEBUG
+        std::cerr << "Sampler::stratified increasing sample size"<<std::endl;
+#endif
+    }
+    samples.clear();
+    samples.reserve(n*n);
+    double factor = 1.0/double(n);
+    double dx = factor;
+    for (int i=0; i< n; i++)
+    {
+        double fi = double(i)*factor;
+        for (int j=0; j<n; j++) {
+            double fj = double(j)*factor;
+            double x = rng.nextd(fi, fi+dx);
+            double y = rng.nextd(fj, fj+dx);
+            samples.push_back(Math::Vec2d(x,y));
+        }
+    }
+}
+
+const Sampler*
+Sampler::get(SamplerType type)
+{
+    switch (type)
+    {
+        case SOBOL_SAMPLER:
+            return &g_sobol;
+        case HALTON_SAMPLER:
+            return &g_halton;
+        default:
+            return NULL;
+    }
+}
+
+bool
+Sampler::parse(const char *name, SamplerType &type)
+{
+    if (strcmp(name, "stratified") == 0)
+        type = STRATIFIED_SAMPLER;
+    else if (strcmp(name, "sobol") == 0)
+        type = SOBOL_SAMPLER;
+    else if (strcmp(name, "halton") == 0)
+        type = HALTON_SAMPLER;
+    else
+        return false;
+    return true;
+}
+
+const uint32_t SobolSampler::s_directions[2][32] = {
+    {   // van der Corput
+        0x80000000, 0x40000000, 0x20000000, 0x10000000,
+        0x08000000, 0x04000000, 0x02000000, 0x01000000,
+        0x00800000, 0x00400000, 0x00200000, 0x00100000,
+        0x00080000, 0x00040000, 0x00020000, 0x00010000,
+        0x00008000, 0x00004000, 0x00002000, 0x00001000,
+        0x00000800, 0x00000400, 0x00000200, 0x00000100,
+        0x00000080, 0x00000040, 0x00000020, 0x00000010,
+        0x00000008, 0x00000004, 0x00000002, 0x00000001
+    },
+    {   // primitive polynomial x+1
+        0x80000000, 0xc0000000, 0xa0000000, 0xf0000000,
+        0x88000000, 0xcc000000, 0xaa000000, 0xff000000,
+        0x80800000, 0xc0c00000, 0xa0a00000, 0xf0f00000,
+        0x88880000, 0xcccc0000, 0xaaaa0000, 0xffff0000,
+        0x80008000, 0xc000c000, 0xa000a000, 0xf000f000,
+        0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00,
+        0x80808080, 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0,
+        0x88888888, 0xcccccccc, 0xaaaaaaaa, 0xffffffff
+    }
+};
+
+Math::Vec2d
+SobolSampler::sample(uint32_t index, uint64_t scramble) const
+{
+    uint32_t x = 0, y = 0;
+    for (int k=0; index; k++, index >>= 1)
+    {
+        if (index & 1)
+        {
+            x ^= s_directions[0][k];
+            y ^= s_directions[1][k];
+        }
+    }
+    return Math::Vec2d(toUnit(owenScramble(x, uint32_t(scramble))),
+                       toUnit(owenScramble(y, uint32_t(scramble >> 32))));
+}
+
+const uint8_t HaltonSampler::s_permutations[6][3] = {
+    {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}
+};
+
+Math::Vec2d
+HaltonSampler::sample(uint32_t index, uint64_t scramble) const
+{
+    // base 2: a random digit permutation is an xor
+    const uint32_t flip = uint32_t((scramble*0x9e3779b97f4a7c15ULL) >> 32);
+    const double x = toUnit(reverseBits(index) ^ flip);
+
+    // base 3: one of the six digit permutations per digit
+    double y = 0.0;
+    double scale = 1.0/3.0;
+    uint64_t h = scramble;
+    for (int d=0; d<BASE3_DIGITS; d++)
+    {
+        const uint8_t *perm = s_permutations[h%6];
+        h /= 6;
+        y += perm[index%3]*scale;
+        index /= 3;
+        scale *= 1.0/3.0;
+    }
+    return Math::Vec2d(x, y);
+}
@@ -0,0 +1,70 @@
+//
+//  Sampler.h
+//  RaytracerV3
+//
+
+#ifndef __RaytracerV3__Sampler__
+#define __RaytracerV3__Sampler__
+
+#include <vector>
+#include <stdint.h>
+#include "Math/Vec2.h"
+#include "Math/PCG.h"
+
+// Sample sets of Scene::generateSamples and the camera jitter
+enum SamplerType {
+    STRATIFIED_SAMPLER,     // jittered strata (N rounded up to a square)
+    SOBOL_SAMPLER,          // Owen scrambled Sobol (0,2)-sequence
+    HALTON_SAMPLER          // Halton (2,3) with random digit permutations
+};
+
+// Two dimensional low discrepancy sequences. A point only depends on its
+// index and a 64 bit scramble, so every prefix of a sequence is well
+// distributed: the camera uses the sample number of a pixel as index and
+// a scramble per pixel, sample sets use a fresh scramble every time.
+class Sampler
+{
+public:
+    virtual ~Sampler() {}
+
+    // Point index of the sequence selected by scramble, in [0,1)^2
+    virtual Math::Vec2d sample(uint32_t index, uint64_t scramble) const = 0;
+
+    // The first N points of a sequence scrambled with a value from rng
+    void generate(std::vector<Math::Vec2d> &samples, int N,
+                  Math::PCG32 &rng) const;
+
+    // Shared instances, NULL for STRATIFIED_SAMPLER
+    static const Sampler* get(SamplerType type);
+
+    // n x n jittered strata, N is rounded up to the next square
+    static void stratified(std::vector<Math::Vec2d> &samples, int N,
+                           Math::PCG32 &rng);
+
+    // "stratified", "sobol" or "halton"
+    static bool parse(const char *name, SamplerType &type);
+};
+
+class SobolSampler: public Sampler
+{
+public:
+    virtual Math::Vec2d sample(uint32_t index, uint64_t scramble) const;
+
+private:
+    // Direction numbers of the first two Sobol dimensions, bit 31 first
+    static const uint32_t s_directions[2][32];
+};
+
+class HaltonSampler: public Sampler
+{
+public:
+    virtual Math::Vec2d sample(uint32_t index, uint64_t scramble) const;
+
+private:
+    // All 20 base 3 digits of a 32 bit index are permuted, including the
+    // leading zeros, otherwise the scramble would not be uniform.
+    static const int BASE3_DIGITS = 20;
+    static const uint8_t s_permutations[6][3];
+};
+
+#endif /* defined(__RaytracerV3__Sampler__) */
@@ -9,55 +9,149 @@
 #include "Scene.h"
 #include "Shape.h"
 #include "PhotonMap.h"
+#include "Octree.h"
+#include "SamplePool.h"
+#include "Math/LineAlgo.h"
+#include "Platform/Stopwatch.h"
+#include <algorithm>
+
+PhotonStatistics::PhotonStatistics():
+    escaped(0),
+    absorbed(0),
+    roulette(0),
+    capped(0)
+{
+}
+
+void
+PhotonStatistics::print() const
+{
+    std::cout << "Photon paths: " << escaped << " escaped, "
+              << absorbed << " absorbed, "
+              << roulette << " terminated by roulette, "
+              << capped << " hit the bounce limit" << std::endl;
+    for (size_t i=0; i<hits.size(); i++)
+    {
+        std::cout << "  bounce " << i << ": " << hits[i] << " photons" << std::endl;
+    }
+}
+
+namespace
+{
+    // the stream of the calling thread
+    __thread Math::PCG32 t_rng;
+    
+    // the sample sets of the calling thread, created on first use and
+    // kept for the lifetime of the thread (OpenMP reuses its workers)
+    __thread SamplePool *t_pool = NULL;
+    
+    // splitmix64 finalizer, decorrelates neighbouring seeds
+    inline uint64_t
+    mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+}
 
 Scene::Scene():
-    rand_gen(new Math::RandMT(time(NULL))),
+    seed(0),
+    sampler(STRATIFIED_SAMPLER),
 photonMap(NULL),
 specularPhotonMap(NULL),
+irradianceMap(NULL),
+volumeMap(NULL),
     _monteCarloSamples(32)
 {
 //    maxPhotonMapSearchDist = 0.1;
     maxPhotonMapSearchDist = 10.0;
     numPhotonMapPhotons = 100;
+    tileSize = 32;
+    renderThreads = 0;
+    precomputeIrradiance = true;
+    irradianceStride = 4;
+    maxPhotonBounces = 16;
+    photonScale = 1.0;
+    photonMapIndex = KD_TREE;
+    photonGridCellSize = 0.0;
+    useProjectionMaps = false;
+    causticPhotons = 100000;
+    
+    progressivePasses = 256;
+    
+    adaptiveMinSamples = 4;
+    adaptiveBatch = 4;
+    adaptiveSamplesPerPixel = 16.0;
+    adaptiveThreshold = 0.02;
+    
+    timeBudgetPhotonShare = 0.3;
+    
+    denoise = false;
+    denoiseIterations = 5;
+    
+    sppmPhotonsPerPass = 100000;
+    sppmPasses = 256;
+    sppmInitialRadius = 0.05;
+    sppmAlpha = 0.7;
     
     sigma_s = 0.1;
     sigma_t = 0.0001;
     rayMarchScatter = 0.1;
+    volumePhotons = 100000;
+    volumePhotonRadius = 0.05;
 }
 
 Scene::~Scene()
 {
-    delete rand_gen;
     delete photonMap;
     delete specularPhotonMap;
+    delete irradianceMap;
+    delete volumeMap;
 }
 
 void
 Scene::generateStratifiedJitteredSamples(std::vector<Math::Vec2d> &samples,
                                          int N) const
 {
-    int n = floor(sqrtf(N));
-    if (N != n*n) {
-        n++;
-        N = n*n;
-#ifdef DEBUG
-        std::cerr << "Scene::generateStratifiedJitteredSamples increasing sample size"<<std::endl;
-#endif
+    Sampler::stratified(samples, N, rng());
+}
+
+void
+Scene::generateSamples(std::vector<Math::Vec2d> &samples, int N) const
+{
+    const Sampler *s = Sampler::get(sampler);
+    if (s == NULL)
+    {
+        generateStratifiedJitteredSamples(samples, N);
+        return;
     }
-    samples.clear();
-    samples.reserve(n*n);
-    double factor = 1.0/double(n);
-    double dx = factor;
-    for (int i=0; i< n; i++)
+    s->generate(samples, N, rng());
+}
+
+const Math::Vec2d*
+Scene::pooledSamples(int N, int &count) const
+{
+    if (t_pool == NULL)
     {
-        double fi = double(i)*factor;
-        for (int j=0; j<n; j++) {
-            double fj = double(j)*factor;
-            double x = rand_gen->nextd(fi, fi+dx);
-            double y = rand_gen->nextd(fj, fj+dx);
-            samples.push_back(Math::Vec2d(x,y));
-        }
+        t_pool = new SamplePool();
+    }
+    return t_pool->rotatedSet(N, sampler, seed, rng(), count);
+}
+
+Math::Vec2d
+Scene::pixelJitter(int x, int y, uint64_t sample) const
+{
+    const Sampler *s = Sampler::get(sampler);
+    if (s == NULL)
+    {
+        double dx = rng().nextd()-0.5;
+        double dy = rng().nextd()-0.5;
+        return Math::Vec2d(dx, dy);
     }
+    // the same scramble for all samples of a pixel
+    uint64_t stream = uint64_t(y)*camera.xRes()+uint64_t(x);
+    return s->sample(uint32_t(sample), mix(seed ^ mix(~stream)))-Math::Vec2d(0.5, 0.5);
 }
 
 void
@@ -68,8 +162,8 @@ Scene::generateRandomSamples(std::vector<Math::Vec2d> &samples,
     samples.reserve(N);
     for (int i=0; i<N; i++)
     {
-        double x = rand_gen->nextd(0.0,1.0);
-        double y = rand_gen->nextd(0.0,1.0);
+        double x = rng().nextd(0.0,1.0);
+        double y = rng().nextd(0.0,1.0);
         samples.push_back(Math::Vec2d(x,y));
     }
 }
@@ -124,60 +218,360 @@ Scene::intersect(Ray &r) const {
     return s_hit;
 }
 
+Math::PCG32&
+Scene::rng() const
+{
+    if (t_rng.inc == 0)
+    {
+        // never seeded on this thread
+        seedStream(PHOTON_STREAM+2);
+    }
+    return t_rng;
+}
+
+void
+Scene::seedStream(uint64_t stream, uint64_t sample) const
+{
+    t_rng.seed(mix(seed ^ mix(sample)), stream);
+}
+
+void
+Scene::seedPixel(int x, int y, uint64_t sample) const
+{
+    seedStream(uint64_t(y)*camera.xRes()+x, sample);
+}
+
 void
 Scene::emit_scatterPhotons()
 {
     std::cout << "Emitting Photons..." << std::endl;
+    seedStream(PHOTON_STREAM);
     std::vector<EmittedPhoton> emittedPhotons;
     for (PhotonSource *source: photonSources)
     {
-        source->emitPhotons(emittedPhotons, *this);
+        if (useProjectionMaps &&
+            source->emitCausticPhotons(emittedPhotons, *this, scaledPhotons(causticPhotons)) > 0)
+        {
+            // caustics of this light are covered by the projection map
+            size_t first = emittedPhotons.size();
+            source->emitPhotons(emittedPhotons, *this, scaledPhotons(source->photons));
+            for (size_t i=first; i<emittedPhotons.size(); i++)
+            {
+                emittedPhotons[i].target = GLOBAL_ONLY;
+            }
+            continue;
+        }
+        source->emitPhotons(emittedPhotons, *this, scaledPhotons(source->photons));
     }
     
-    photonMap = new PhotonMap(1024*1024*1024);
-    specularPhotonMap = new PhotonMap(1024*1024*1024);
+    // every bounce stores at most one photon per map
+    const long capacity = std::min(long(emittedPhotons.size())*std::max(maxPhotonBounces, 1),
+                                   long(1024*1024*1024));
+    photonMap = new PhotonMap(int(capacity));
+    specularPhotonMap = new PhotonMap(int(capacity));
+    float cellSize = photonGridCellSize > 0 ? photonGridCellSize : maxPhotonMapSearchDist;
+    photonMap->set_index(photonMapIndex, cellSize);
+    specularPhotonMap->set_index(photonMapIndex, cellSize);
     std::cout << "Scattering Photons..." << std::endl;
+    PhotonStatistics stats;
     for (size_t i=0; i<emittedPhotons.size(); i++)
     {
         photonScattering(emittedPhotons[i],
                          *photonMap,
-                         *specularPhotonMap);
+                         *specularPhotonMap,
+                         &stats);
+    }
+    stats.print();
+    if (photonMap->dropped() > 0 || specularPhotonMap->dropped() > 0)
+    {
+        std::cerr << "Photon maps full, dropped " << photonMap->dropped() << " and "
+                  << specularPhotonMap->dropped() << " photons" << std::endl;
     }
+    Platform::Stopwatch indexTimer;
+    indexTimer.start();
     photonMap->balance();
     specularPhotonMap->balance();
+    indexTimer.stop();
+    std::cout << (photonMapIndex == HASH_GRID ? "Hash grids" : "Kd-trees") << " of "
+              << photonMap->size() << " and " << specularPhotonMap->size()
+              << " photons built in " << indexTimer.elapsedSeconds() << "s" << std::endl;
+    
+    if (precomputeIrradiance)
+    {
+        std::cout << "Precomputing Irradiance..." << std::endl;
+        irradianceMap = new PhotonMap(photonMap->size()/irradianceStride+1);
+        photonMap->precompute_irradiance(*irradianceMap,
+                                         irradianceStride,
+                                         maxPhotonMapSearchDist,
+                                         numPhotonMapPhotons);
+    }
+    
+    if (!fog.empty())
+    {
+        emit_volumePhotons();
+    }
+}
+
+void
+Scene::emit_volumePhotons()
+{
+    std::cout << "Emitting Volume Photons..." << std::endl;
+    Math::Box<Math::Vec3d> bounds;
+    for (const Math::Box<Math::Vec3d>& box: fog)
+    {
+        bounds.enclose(box);
+    }
+    volumeMap = new Octree(OCTREEMAXDEPTH, bounds.min, bounds.max);
+    seedStream(VOLUME_STREAM);
+    
+    std::vector<EmittedPhoton> emittedPhotons;
+    for (PhotonSource *source: photonSources)
+    {
+        source->emitPhotons(emittedPhotons, *this, scaledPhotons(volumePhotons));
+    }
+    
+    // Deposit photons along the unscattered light paths (single
+    // scattering). Each carries the power transmitted to it times the
+    // step length, the track length estimate of the fluence.
+    long stored = 0;
+    for (const EmittedPhoton& photon: emittedPhotons)
+    {
+        Ray r;
+        r.o = photon.position+0.001*photon.dir;
+        r.d = photon.dir;
+        double tHit = intersect(r) != NULL ? r.hit.t : r.tMax;
+        
+        for (const Math::Box<Math::Vec3d>& box: fog)
+        {
+            double tMin, tMax;
+            if (!Math::intersects<Math::Vec3d>(r.o, r.d, box, 0.0, tHit, &tMin, &tMax))
+            {
+                continue;
+            }
+            for (double t = tMin+rayMarchScatter*rng().nextd(); t < tMax; t += rayMarchScatter)
+            {
+                VolumetricPhoton vp;
+                vp.position = r.o+r.d*t;
+                double f = exp(-sigma_t*(t-tMin))*rayMarchScatter;
+                vp.power = Math::Vec3d(photon.power.x*f, photon.power.y*f, photon.power.z*f);
+                vp.radius = volumePhotonRadius;
+                volumeMap->add(vp);
+                stored++;
+            }
+        }
+    }
+    volumeMap->build();
+    std::cout << "Stored " << stored << " volume photons" << std::endl;
 }
 
 void
 Scene::photonScattering(EmittedPhoton photon,
                         PhotonMap &photonMap,
-                        PhotonMap &specularPhotonMap) const
+                        PhotonMap &specularPhotonMap,
+                        PhotonStatistics *stats) const
 {
-    Ray r;
-    r.o = photon.position+0.001*photon.dir;
-    r.d = photon.dir;
-    
-    Shape* hitShape = intersect(r);
-    if (hitShape != NULL)
+    for (int bounce = 0; bounce < maxPhotonBounces; bounce++)
     {
+        Ray r;
+        r.o = photon.position+0.001*photon.dir;
+        r.d = photon.dir;
+        
+        Shape* hitShape = intersect(r);
+        if (hitShape == NULL)
+        {
+            if (stats) stats->escaped++;
+            return;
+        }
+        if (stats)
+        {
+            if (int(stats->hits.size()) <= bounce)
+                stats->hits.resize(bounce+1, 0);
+            stats->hits[bounce]++;
+        }
+        
         hitShape->fillHitInfo(r);
         if (hitShape->surfaceShader == NULL)
         {
+            if (stats) stats->absorbed++;
+            return;
+        }
+        
+        float incoming = std::max(photon.power.x, std::max(photon.power.y, photon.power.z));
+        if (!r.hit.surfaceShader->processPhoton(r.hit,
+                                                photon,
+                                                photonMap,
+                                                specularPhotonMap,
+                                                *this))
+        {
+            if (stats) stats->absorbed++;
             return;
         }
-        r.hit.surfaceShader->processPhoton(r.hit,
-                                           photon,
-                                           photonMap,
-                                           specularPhotonMap,
-                                           *this);
+        
+        // Russian roulette on the power the surface reflected; survivors
+        // are reweighted so that the estimate stays unbiased.
+        float outgoing = std::max(photon.power.x, std::max(photon.power.y, photon.power.z));
+        float survival = incoming > 0.0f ? std::min(1.0f, outgoing/incoming) : 0.0f;
+        if (survival < 1.0f)
+        {
+            if (rng().nextf() >= survival)
+            {
+                if (stats) stats->roulette++;
+                return;
+            }
+            photon.power /= survival;
+        }
+    }
+    if (stats) stats->capped++;
+}
+
+int
+Scene::scaledPhotons(int count) const
+{
+    if (count <= 0)
+    {
+        return count;
     }
+    return std::max(int(count*photonScale), 1);
 }
 
 void
-Scene::reset()
+Scene::clearPhotonMaps()
 {
     delete photonMap;
     delete specularPhotonMap;
+    delete irradianceMap;
+    delete volumeMap;
+    photonMap = NULL;
+    specularPhotonMap = NULL;
+    irradianceMap = NULL;
+    volumeMap = NULL;
+}
+
+void
+Scene::reset()
+{
+    clearPhotonMaps();
     fog.clear();
     shapes.clear();
     photonSources.clear();
-}
\ No newline at end of file
+}
+
+bool
+Scene::savePhotonMaps(const std::string &filename) const
+{
+    if (photonMap == NULL || specularPhotonMap == NULL)
+    {
+        std::cerr << "Scene::savePhotonMaps: no photon maps" << std::endl;
+        return false;
+    }
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (file == NULL)
+    {
+        std::cerr << "Scene::savePhotonMaps: could not open " << filename << std::endl;
+        return false;
+    }
+    
+    int flags[2] = {irradianceMap != NULL, volumeMap != NULL};
+    bool ok = fwrite(flags, sizeof(int), 2, file) == 2 &&
+              photonMap->write(file) &&
+              specularPhotonMap->write(file);
+    if (ok && irradianceMap != NULL)
+    {
+        ok = irradianceMap->write(file);
+    }
+    if (ok && volumeMap != NULL)
+    {
+        const std::vector<VolumetricPhoton> &photons = volumeMap->photons();
+        int header[2] = {volumeMap->maxDepth, int(photons.size())};
+        double bounds[6] = {volumeMap->getBBoxMin().x, volumeMap->getBBoxMin().y, volumeMap->getBBoxMin().z,
+                            volumeMap->getBBoxMax().x, volumeMap->getBBoxMax().y, volumeMap->getBBoxMax().z};
+        ok = fwrite(header, sizeof(int), 2, file) == 2 &&
+             fwrite(bounds, sizeof(double), 6, file) == 6;
+        for (size_t i=0; ok && i<photons.size(); i++)
+        {
+            const VolumetricPhoton &p = photons[i];
+            double v[7] = {p.position.x, p.position.y, p.position.z,
+                           p.power.x, p.power.y, p.power.z, p.radius};
+            ok = fwrite(v, sizeof(double), 7, file) == 7;
+        }
+    }
+    fclose(file);
+    
+    if (!ok)
+    {
+        std::cerr << "Scene::savePhotonMaps: could not write " << filename << std::endl;
+    }
+    return ok;
+}
+
+bool
+Scene::loadPhotonMaps(const std::string &filename)
+{
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file == NULL)
+    {
+        std::cerr << "Scene::loadPhotonMaps: could not open " << filename << std::endl;
+        return false;
+    }
+    
+    delete photonMap;
+    delete specularPhotonMap;
+    delete irradianceMap;
+    delete volumeMap;
+    photonMap = new PhotonMap(1);
+    specularPhotonMap = new PhotonMap(1);
+    irradianceMap = NULL;
+    volumeMap = NULL;
+    
+    int flags[2];
+    bool ok = fread(flags, sizeof(int), 2, file) == 2 &&
+              photonMap->read(file) &&
+              specularPhotonMap->read(file);
+    if (ok && flags[0])
+    {
+        irradianceMap = new PhotonMap(1);
+        ok = irradianceMap->read(file);
+    }
+    if (ok && flags[1])
+    {
+        int header[2];
+        double bounds[6];
+        ok = fread(header, sizeof(int), 2, file) == 2 &&
+             fread(bounds, sizeof(double), 6, file) == 6;
+        if (ok)
+        {
+            volumeMap = new Octree(header[0],
+                                   Math::Vec3d(bounds[0], bounds[1], bounds[2]),
+                                   Math::Vec3d(bounds[3], bounds[4], bounds[5]));
+        }
+        for (int i=0; ok && i<header[1]; i++)
+        {
+            double v[7];
+            ok = fread(v, sizeof(double), 7, file) == 7;
+            VolumetricPhoton p;
+            p.position = Math::Vec3d(v[0], v[1], v[2]);
+            p.power = Math::Vec3d(v[3], v[4], v[5]);
+            p.radius = v[6];
+            volumeMap->add(p);
+        }
+        if (ok)
+        {
+            volumeMap->build();
+        }
+    }
+    fclose(file);
+    
+    if (!ok)
+    {
+        std::cerr << "Scene::loadPhotonMaps: could not read " << filename << std::endl;
+        delete photonMap;
+        delete specularPhotonMap;
+        delete irradianceMap;
+        delete volumeMap;
+        photonMap = NULL;
+        specularPhotonMap = NULL;
+        irradianceMap = NULL;
+        volumeMap = NULL;
+    }
+    return ok;
+}
@@ -11,34 +11,140 @@
 
 #include <vector>
 #include <iostream>
+#include <string>
 #include "Camera.h"
-#include "Math/Rand.h"
+#include "Math/PCG.h"
+#include "Sampler.h"
 #include "PhotonSource.h"
 #include "PhotonMap.h"
 #include "Math/Box.h"
 class Light;
 class Shape;
+class Octree;
 using namespace std;
+
+// Counts how far photons travel in Scene::photonScattering
+struct PhotonStatistics
+{
+    PhotonStatistics();
+    
+    vector<long> hits;      // photons hitting a surface, per bounce
+    long escaped;           // left the scene
+    long absorbed;          // absorbed by a surface
+    long roulette;          // terminated by Russian roulette
+    long capped;            // reached Scene::maxPhotonBounces
+    
+    void print() const;
+};
+
 class Scene
 {
 public:
     Scene();
     ~Scene();
-    Math::RandMT *rand_gen;
+    
+    // Random numbers. Every thread draws from its own PCG32 stream,
+    // rng(). Renderers switch to the stream of a pixel and sample with
+    // seedPixel() before tracing it, so an image only depends on seed and
+    // not on how the pixels are distributed over the threads.
+    uint64_t seed;
+    Math::PCG32& rng() const;
+    void seedStream(uint64_t stream, uint64_t sample = 0) const;
+    void seedPixel(int x, int y, uint64_t sample) const;
+    
+    // Streams of the (serial) photon tracing, above all pixel streams
+    static const uint64_t PHOTON_STREAM = uint64_t(1) << 48;
+    static const uint64_t VOLUME_STREAM = PHOTON_STREAM+1;
+    
+    // Sample sets of the final gather and the light emission, and the
+    // camera jitter. The low discrepancy samplers are only used for the
+    // first two dimensions, deeper bounces keep drawing from rng().
+    SamplerType sampler;
+    void generateSamples(std::vector<Math::Vec2d> &samples, int N) const;
+    
+    // Like generateSamples, but from the SamplePool of the calling thread,
+    // without allocating. Valid until the next call on this thread.
+    const Math::Vec2d* pooledSamples(int N, int &count) const;
+    
+    // Sub pixel offset in [-0.5,0.5)^2 of a camera sample, call after
+    // seedPixel(x, y, sample)
+    Math::Vec2d pixelJitter(int x, int y, uint64_t sample) const;
 
     vector<Shape *> shapes;
     vector<PhotonSource *> photonSources;
     vector<Math::Box<Math::Vec3d> > fog;
     PhotonMap *photonMap;
     PhotonMap *specularPhotonMap;
+    PhotonMap *irradianceMap;
+    Octree *volumeMap;
     double sigma_t;
     double sigma_s;
     double rayMarchScatter;
+    // Volumetric photons are deposited every rayMarchScatter along the
+    // light paths through the fog and gathered within volumePhotonRadius.
+    int volumePhotons;
+    double volumePhotonRadius;
     Camera camera;
     
+    // Image tiles rendered per scheduler task, and render threads
+    // (0 uses the OpenMP default)
+    int tileSize;
+    int renderThreads;
+    
     float maxPhotonMapSearchDist;
     float numPhotonMapPhotons;
     
+    // Precompute irradiance at every irradianceStride-th photon of
+    // photonMap, so that final gather lookups become a single
+    // nearest neighbour query.
+    bool precomputeIrradiance;
+    int irradianceStride;
+    
+    // Photon paths end after maxPhotonBounces surface interactions
+    int maxPhotonBounces;
+    
+    // Scales the photon counts of the lights and the caustic and volume
+    // photon counts, e.g. to fit photon tracing into a time budget
+    double photonScale;
+    int scaledPhotons(int count) const;
+    
+    // Spatial index of photonMap and specularPhotonMap. A grid cell
+    // size of 0 uses maxPhotonMapSearchDist.
+    PhotonIndex photonMapIndex;
+    float photonGridCellSize;
+    
+    // Emit causticPhotons extra photons per light towards specular
+    // objects only (projection maps) to fill specularPhotonMap.
+    bool useProjectionMaps;
+    int causticPhotons;
+    
+    // Samples per pixel of the progressive PhotonMapper mode
+    int progressivePasses;
+    
+    // Adaptive sampling: every pixel gets adaptiveMinSamples, then pixels
+    // whose relative standard error exceeds adaptiveThreshold get
+    // adaptiveBatch more per round until adaptiveSamplesPerPixel (the
+    // average over the image) is used up.
+    int adaptiveMinSamples;
+    int adaptiveBatch;
+    double adaptiveSamplesPerPixel;
+    double adaptiveThreshold;
+    
+    // Runs the edge avoiding denoiser (see Denoiser.h) with
+    // denoiseIterations passes after PhotonMapper::render
+    bool denoise;
+    int denoiseIterations;
+    
+    // Time budgeted rendering: photon tracing gets at most
+    // timeBudgetPhotonShare of the budget, progressive passes the rest.
+    double timeBudgetPhotonShare;
+    
+    // Stochastic progressive photon mapping
+    int sppmPhotonsPerPass;
+    int sppmPasses;
+    double sppmInitialRadius;
+    double sppmAlpha;
+    
     void generateStratifiedJitteredSamples(std::vector<Math::Vec2d> &samples,
                                            int N) const;
     void generateRandomSamples(std::vector<Math::Vec2d> &samples,
@@ -51,10 +157,18 @@ public:
     Shape* intersect(Ray &r) const;
     
     void emit_scatterPhotons();
+    void emit_volumePhotons();
     void photonScattering(EmittedPhoton photon,
                           PhotonMap &photonMap,
-                          PhotonMap &specularPhotonMap) const;
+                          PhotonMap &specularPhotonMap,
+                          PhotonStatistics *stats = NULL) const;
+    void clearPhotonMaps();
     void reset();
+    
+    // Saves / loads all photon maps (and the volume photons), so that
+    // several render processes can share one photon tracing pass.
+    bool savePhotonMaps(const std::string &filename) const;
+    bool loadPhotonMaps(const std::string &filename);
 
     int _monteCarloSamples;
 
@@ -9,6 +9,7 @@
 #include "LambertShader.h"
 
 #include <vector>
+#include <algorithm>
 #include "Light.h"
 #include "Shape.h"
 #include <assert.h>
@@ -69,24 +70,24 @@ LambertShader::shade(const Renderer *renderer,
 
     if (gather)
     {
-        Math::Mat44d tr;
-        tr.makeIdentity();
-        tr.rotateTo(Math::Vec3d(0,0,1), hit.N);
-
-        std::vector<Vec2d> samples;
-        scene.generateStratifiedJitteredSamples(samples, scene.getMonteCarloSamples());
-        double nsamples = double(samples.size());
-        for (const Vec2d sample: samples)
+        int count;
+        const Vec2d *samples = scene.pooledSamples(scene.getMonteCarloSamples(), count);
+        double nsamples = double(count);
+        // warp the samples in batches on the stack
+        const int batchSize = 64;
+        Vec3d dirs[batchSize];
+        for (int first=0; first<count; first+=batchSize)
         {
-            Ray ray;
-            ray.o = hit.P;
-            ray.tMin = 1e-3;
-
-            Vec3d d;
-            Warp::cosineHemisphere(&d, sample.x, sample.y);
-            ray.d = (tr*d).normalize();
-            col += (ray.d).dot(hit.N)*renderer->recursiveRender(ray, photonMap, specularPhotonMap, scene, false)/nsamples;
-                //                    shapeColor += m_kd;
+            const int n = std::min(batchSize, count-first);
+            Warp::cosineHemisphereBatch(dirs, samples+first, n);
+            for (int s=0; s<n; s++)
+            {
+                Ray ray;
+                ray.o = hit.P;
+                ray.tMin = 1e-3;
+                ray.d = hit.frame.toWorld(dirs[s]);
+                col += (ray.d).dot(hit.N)*renderer->recursiveRender(ray, photonMap, specularPhotonMap, scene, false)/nsamples;
+            }
         }
         
         for (PhotonSource *l : scene.photonSources) {
@@ -132,7 +133,11 @@ LambertShader::shade(const Renderer *renderer,
     else
     {
         float irrStdc[3];
-        photonMap.irradiance_estimate(irrStdc, pos, normal, maxDist, nPhotons);
+        if (scene.irradianceMap == NULL ||
+            !scene.irradianceMap->irradiance_lookup(irrStdc, pos, normal, maxDist))
+        {
+            photonMap.irradiance_estimate(irrStdc, pos, normal, maxDist, nPhotons);
+        }
         col += Math::Color3f(irrStdc[0], irrStdc[1], irrStdc[2]);
     }
 //    col *= m_kd;
@@ -140,9 +145,9 @@ LambertShader::shade(const Renderer *renderer,
 }
 
 
-void
+bool
 LambertShader::processPhoton(const HitInfo & hit,
-                             EmittedPhoton photon,
+                             EmittedPhoton &photon,
                              PhotonMap &photonMap,
                              PhotonMap &specularPhotonMap,
                              const Scene &scene) const
@@ -161,32 +166,53 @@ LambertShader::processPhoton(const HitInfo & hit,
     dir[0] = hit.I.x;
     dir[1] = hit.I.y;
     dir[2] = hit.I.z;
-    if (photon.specularBounces)
+    
+    float normal[3];
+    normal[0] = hit.N.x;
+    normal[1] = hit.N.y;
+    normal[2] = hit.N.z;
+    if (photon.specularBounces && photon.target != GLOBAL_ONLY)
+    {
+        specularPhotonMap.store(power, pos, dir, normal);
+    }
+    if (photon.target == CAUSTIC_ONLY)
     {
-        specularPhotonMap.store(power, pos, dir);
+        // a caustic photon ends on the first diffuse surface
+        return false;
     }
-    photonMap.store(power, pos, dir);
+    photonMap.store(power, pos, dir, normal);
 
-    double r = scene.rand_gen->nextd();
-    if (r > surface_reflectance)
+    // the fraction 1-surface_reflectance of the power is reflected,
+    // tinted by the surface colour; Scene turns this into roulette
+    double continuation = 1.0-surface_reflectance;
+    if (continuation <= 0.0)
     {
-//        photon.dir = Math::reflect(hit.N, hit.I);
-        double x = scene.rand_gen->nextd();
-        double y = scene.rand_gen->nextd();
-        Vec3d d;
-        Warp::cosineHemisphere(&d, x, y);
-        Math::Mat44d tr;
-        tr.makeIdentity();
-        tr.rotateTo(Math::Vec3d(0,0,1), hit.N);
-        photon.dir = tr*d;
-        photon.position = hit.P+0.001*hit.N;
-        photon.indirect = true;
-        photon.specularBounces = false;
-        scene.photonScattering(photon, photonMap, specularPhotonMap);
+        return false;
     }
-    
+    double x = scene.rng().nextd();
+    double y = scene.rng().nextd();
+    Vec3d d;
+    Warp::cosineHemisphere(&d, x, y);
+    photon.dir = hit.frame.toWorld(d);
+    photon.position = hit.P+0.001*hit.N;
+    photon.power.x *= m_kd.x*continuation;
+    photon.power.y *= m_kd.y*continuation;
+    photon.power.z *= m_kd.z*continuation;
+    photon.indirect = true;
+    photon.specularBounces = false;
+    return true;
+}
 
-    
+bool
+LambertShader::diffuse() const
+{
+    return true;
+}
+
+Math::Color3f
+LambertShader::albedo() const
+{
+    return m_kd;
 }
 
 LambertShader::LambertShader(const Color3f & kd, double surface_reflectance) :
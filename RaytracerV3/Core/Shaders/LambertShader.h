@@ -31,10 +31,13 @@ public:
                                 const Scene &scene,
                                 bool gather) const;
     
-    virtual void processPhoton(const HitInfo & hit,
-                               EmittedPhoton photon,
+    virtual bool processPhoton(const HitInfo & hit,
+                               EmittedPhoton &photon,
                                PhotonMap &photonMap,
                                PhotonMap &specularPhotonMap,
                                const Scene &scene) const;
+    
+    virtual bool diffuse() const;
+    virtual Math::Color3f albedo() const;
 };
 #endif /* defined(__RaytracerV3__LambertShader__) */
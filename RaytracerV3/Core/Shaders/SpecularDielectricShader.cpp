@@ -64,14 +64,14 @@ SpecularDielectricShader::shade(const Renderer *renderer,
 ;
 }
 
-void
+bool
 SpecularDielectricShader::processPhoton(const HitInfo &hit,
-                                    EmittedPhoton photon,
+                                    EmittedPhoton &photon,
                                     PhotonMap &photonMap,
                                     PhotonMap &specularPhotonMap,
                                     const Scene &scene) const
 {
-    double b = scene.rand_gen->nextd(0.0, 1.0);
+    double b = scene.rng().nextd(0.0, 1.0);
     if (!photon.indirect)
         photon.specularBounces = true;
     double reflectivity = Math::reflectance(hit.N, hit.I, 1.0, refractiveIndex);
@@ -90,7 +90,6 @@ SpecularDielectricShader::processPhoton(const HitInfo &hit,
         hit.shape->fillHitInfo(r);
         photon.dir = Math::refract(-refr, -r.hit.N, refractiveIndex);
         photon.position = r.hit.P+r.hit.N*0.001;
-        scene.photonScattering(photon, photonMap, specularPhotonMap);
     }
     else
     {
@@ -98,7 +97,34 @@ SpecularDielectricShader::processPhoton(const HitInfo &hit,
         photon.dir = Math::reflect(hit.N, hit.I);
         photon.position = hit.P+0.001*hit.N;
     }
+    return true;
+}
 
-    scene.photonScattering(photon, photonMap, specularPhotonMap);
+bool
+SpecularDielectricShader::sampleSpecular(const HitInfo &hit,
+                                         Ray &r,
+                                         Math::Color3f &weight,
+                                         const Scene &scene) const
+{
+    double reflectivity = Math::reflectance(hit.N, hit.I, 1.0, refractiveIndex);
+    if (scene.rng().nextd() < reflectivity)
+    {
+        r = Ray();
+        r.d = Math::reflect(hit.N, hit.I);
+        r.o = hit.P+0.001*hit.N;
+        return true;
+    }
+    
+    // trace through the shape to the exit point
+    Math::Vec3d refr = Math::refract(-hit.I, hit.N, 1.0/refractiveIndex);
+    Ray ri;
+    ri.o = hit.P - 0.001*hit.N;
+    ri.d = refr.normalized();
+    hit.shape->intersect(ri);
+    hit.shape->fillHitInfo(ri);
     
+    r = Ray();
+    r.d = Math::refract(-refr, -ri.hit.N, refractiveIndex).normalized();
+    r.o = ri.hit.P-ri.hit.N*0.001;
+    return true;
 }
\ No newline at end of file
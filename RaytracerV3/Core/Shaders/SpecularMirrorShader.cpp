@@ -39,22 +39,30 @@ SpecularMirrorShader::shade(const Renderer *renderer,
     return renderer->recursiveRender(r, photonMap, specularPhotonMap, scene, gather);
 }
 
-void
+bool
 SpecularMirrorShader::processPhoton(const HitInfo &hit,
-                                    EmittedPhoton photon,
+                                    EmittedPhoton &photon,
                                     PhotonMap &photonMap,
                                     PhotonMap &specularPhotonMap,
                                     const Scene &scene) const
 {
-    double b = scene.rand_gen->nextd(0.0, 1.0);
-    if (b < reflectivity)
-    {
-        return;
-    }
+    // the fraction reflectivity of the power is absorbed
+    photon.power *= float(1.0-reflectivity);
     photon.dir = Math::reflect(hit.N, hit.I);
     photon.position = hit.P+0.001*hit.N;
     if (!photon.indirect)
         photon.specularBounces = true;
-    scene.photonScattering(photon, photonMap, specularPhotonMap);
-    
+    return true;
+}
+
+bool
+SpecularMirrorShader::sampleSpecular(const HitInfo &hit,
+                                     Ray &r,
+                                     Math::Color3f &weight,
+                                     const Scene &scene) const
+{
+    r = Ray();
+    r.d = Math::reflect(hit.N, hit.I);
+    r.o = hit.P+0.001*hit.N;
+    return true;
 }
\ No newline at end of file
@@ -27,12 +27,16 @@ public:
                                 const Scene &scene,
                                 bool gather) const;
     
-    virtual void processPhoton(const HitInfo & hit,
-                               EmittedPhoton photon,
+    virtual bool processPhoton(const HitInfo & hit,
+                               EmittedPhoton &photon,
                                PhotonMap &photonMap,
                                PhotonMap &specularPhotonMap,
                                const Scene &scene) const;
     
+    virtual bool sampleSpecular(const HitInfo & hit,
+                                Ray &r,
+                                Math::Color3f &weight,
+                                const Scene &scene) const;
 };
 
 #endif /* defined(__ImageSynthesisFramework__SpecularMirrorShader__) */
@@ -38,12 +38,33 @@ SurfaceShader::shade(const Renderer *render,
     return Color3f(0,0,0);
 }
 
-void
+bool
 SurfaceShader::processPhoton(const HitInfo & hit,
-                             EmittedPhoton photon,
+                             EmittedPhoton &photon,
                              PhotonMap &photonMap,
                              PhotonMap &specularPhotonMap,
                              const Scene &scene) const
 {
-    return;
+    return false;
+}
+
+bool
+SurfaceShader::diffuse() const
+{
+    return false;
+}
+
+Math::Color3f
+SurfaceShader::albedo() const
+{
+    return Math::Color3f(0.0f);
+}
+
+bool
+SurfaceShader::sampleSpecular(const HitInfo & hit,
+                              Ray &r,
+                              Math::Color3f &weight,
+                              const Scene &scene) const
+{
+    return false;
 }
\ No newline at end of file
@@ -13,6 +13,7 @@ class HitInfo;
 class Scene;
 class PhotonMap;
 class Renderer;
+class Ray;
 #include "Math/Color.h"
 #include <iostream>
 #include "PhotonSource.h"
@@ -33,11 +34,29 @@ public:
                                 const Scene &scene,
                                 bool gather) const;
     
-    virtual void processPhoton(const HitInfo & hit,
-                               EmittedPhoton photon,
+    // Stores the photon if the surface is diffuse and samples its next
+    // direction. Returns false if the photon is absorbed, otherwise
+    // photon holds the new origin, direction and power (scaled by the
+    // surface reflectance; Scene applies Russian roulette).
+    virtual bool processPhoton(const HitInfo & hit,
+                               EmittedPhoton &photon,
                                PhotonMap &photonMap,
                                PhotonMap &specularPhotonMap,
                                const Scene &scene) const;
     
+    // True if hit points on this surface store photon density estimates.
+    virtual bool diffuse() const;
+    
+    // Diffuse reflectance of the surface.
+    virtual Math::Color3f albedo() const;
+    
+    // Continues a camera path through a specular surface. Returns false if
+    // the surface is not specular, otherwise r is the continued ray and
+    // weight its throughput.
+    virtual bool sampleSpecular(const HitInfo & hit,
+                                Ray &r,
+                                Math::Color3f &weight,
+                                const Scene &scene) const;
+    
 };
 #endif /* defined(__RaytracerV3__SurfaceShader__) */
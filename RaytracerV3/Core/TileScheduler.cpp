@@ -0,0 +1,146 @@
+//
+//  TileScheduler.cpp
+//  RaytracerV3
+//
+
+#include "TileScheduler.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Converts the distance d along a Hilbert curve covering an n x n grid
+// (n a power of two) to grid coordinates.
+static void
+hilbertToXY(int n, int d, int &x, int &y)
+{
+    x = y = 0;
+    for (int s=1; s<n; s*=2)
+    {
+        int rx = 1 & (d/2);
+        int ry = 1 & (d ^ rx);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s-1-x;
+                y = s-1-y;
+            }
+            std::swap(x, y);
+        }
+        x += s*rx;
+        y += s*ry;
+        d /= 4;
+    }
+}
+
+std::vector<TileScheduler::Tile>
+TileScheduler::tiles(int width, int height, int tileSize)
+{
+    tileSize = std::max(tileSize, 1);
+    
+    // tiles along the Hilbert curve of the enclosing power of two grid
+    int tilesX = (width+tileSize-1)/tileSize;
+    int tilesY = (height+tileSize-1)/tileSize;
+    int n = 1;
+    while (n < tilesX || n < tilesY)
+        n *= 2;
+    
+    std::vector<Tile> tiles;
+    tiles.reserve(tilesX*tilesY);
+    for (int d=0; d<n*n; d++)
+    {
+        int tx, ty;
+        hilbertToXY(n, d, tx, ty);
+        if (tx >= tilesX || ty >= tilesY)
+            continue;
+        Tile tile;
+        tile.x0 = tx*tileSize;
+        tile.y0 = ty*tileSize;
+        tile.x1 = std::min(tile.x0+tileSize, width);
+        tile.y1 = std::min(tile.y0+tileSize, height);
+        tiles.push_back(tile);
+    }
+    return tiles;
+}
+
+TileScheduler::TileScheduler(int width, int height, int tileSize, int threads)
+{
+    if (threads <= 0)
+    {
+#ifdef _OPENMP
+        threads = omp_get_max_threads();
+#else
+        threads = 1;
+#endif
+    }
+    
+    std::vector<Tile> tiles = TileScheduler::tiles(width, height, tileSize);
+    m_numTiles = int(tiles.size());
+    
+    // every thread starts on its own stretch of the curve
+    m_queues.resize(threads);
+    for (int t=0; t<threads; t++)
+    {
+        m_queues[t] = new Queue();
+        int begin = int((long(m_numTiles)*t)/threads);
+        int end = int((long(m_numTiles)*(t+1))/threads);
+        m_queues[t]->tiles.assign(tiles.begin()+begin, tiles.begin()+end);
+    }
+}
+
+TileScheduler::~TileScheduler()
+{
+    for (Queue *q: m_queues)
+    {
+        delete q;
+    }
+}
+
+bool
+TileScheduler::next(int thread, Tile &tile)
+{
+    // own work from the front
+    {
+        Queue &q = *m_queues[thread];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (!q.tiles.empty())
+        {
+            tile = q.tiles.front();
+            q.tiles.pop_front();
+            return true;
+        }
+    }
+    // steal from the back of the other queues
+    const int threads = numThreads();
+    for (int i=1; i<threads; i++)
+    {
+        Queue &q = *m_queues[(thread+i)%threads];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (!q.tiles.empty())
+        {
+            tile = q.tiles.back();
+            q.tiles.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+TileScheduler::run(const std::function<void (const Tile&)> &renderTile)
+{
+    const int threads = numThreads();
+    #pragma omp parallel num_threads(threads)
+    {
+        int thread = 0;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+#endif
+        Tile tile;
+        while (next(thread, tile))
+        {
+            renderTile(tile);
+        }
+    }
+}
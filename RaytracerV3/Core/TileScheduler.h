@@ -0,0 +1,53 @@
+//
+//  TileScheduler.h
+//  RaytracerV3
+//
+
+#ifndef __RaytracerV3__TileScheduler__
+#define __RaytracerV3__TileScheduler__
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <functional>
+
+// Splits the image into square tiles, ordered along a Hilbert curve so
+// that consecutive tiles are neighbours. Every thread owns a contiguous
+// part of that sequence and steals from the other threads when it runs
+// out of work.
+class TileScheduler
+{
+public:
+    struct Tile
+    {
+        int x0, y0;     // first pixel
+        int x1, y1;     // one past the last pixel
+    };
+    
+    // threads <= 0 uses the OpenMP default
+    TileScheduler(int width, int height, int tileSize, int threads = 0);
+    ~TileScheduler();
+    
+    // All tiles of the image in Hilbert curve order
+    static std::vector<Tile> tiles(int width, int height, int tileSize);
+    
+    // Calls renderTile for every tile, in parallel.
+    void run(const std::function<void (const Tile&)> &renderTile);
+    
+    int numTiles() const {return m_numTiles;}
+    int numThreads() const {return int(m_queues.size());}
+    
+private:
+    struct Queue
+    {
+        std::deque<Tile> tiles;
+        std::mutex lock;
+    };
+    
+    bool next(int thread, Tile &tile);
+    
+    int m_numTiles;
+    std::vector<Queue*> m_queues;
+};
+
+#endif /* defined(__RaytracerV3__TileScheduler__) */
@@ -0,0 +1,465 @@
+//
+//  DistributedRenderer.cpp
+//  RaytracerV3
+//
+
+#include "DistributedRenderer.h"
+#include "PhotonMapper.h"
+#include "Platform/Progress.h"
+#include "Platform/Stopwatch.h"
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <iostream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace Main;
+
+namespace
+{
+    // Size and 64 bit FNV-1a hash of a file, so that a worker can tell
+    // whether its copy of the photon file is the one of this render
+    bool
+    fileChecksum(const std::string &filename, long long &size, uint64_t &checksum)
+    {
+        FILE *file = fopen(filename.c_str(), "rb");
+        if (file == NULL)
+            return false;
+        size = 0;
+        checksum = 14695981039346656037ULL;
+        std::vector<unsigned char> buffer(1 << 20);
+        size_t n;
+        while ((n = fread(&buffer[0], 1, buffer.size(), file)) > 0)
+        {
+            for (size_t i=0; i<n; i++)
+            {
+                checksum = (checksum ^ buffer[i])*1099511628211ULL;
+            }
+            size += n;
+        }
+        bool ok = !ferror(file);
+        fclose(file);
+        return ok;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Coordinator
+
+RenderCoordinator::RenderCoordinator(Scene &scene, const BatchOptions &options):
+    scene(scene),
+    options(options),
+    m_completed(0),
+    m_photonSize(0),
+    m_photonChecksum(0)
+{
+    
+}
+
+RenderCoordinator::~RenderCoordinator()
+{
+    for (Client *client: m_clients)
+    {
+        delete client;
+    }
+    for (pid_t child: m_children)
+    {
+        waitpid(child, NULL, 0);
+    }
+}
+
+void
+RenderCoordinator::spawnWorkers(int port)
+{
+    std::stringstream address, threads;
+    address << "127.0.0.1:" << port;
+    threads << options.threads;
+    for (int w=0; w<options.spawnWorkers; w++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("RenderCoordinator: fork");
+            return;
+        }
+        if (pid == 0)
+        {
+            execlp(options.program.c_str(), options.program.c_str(),
+                   "--worker", address.str().c_str(),
+                   "--threads", threads.str().c_str(), (char*)NULL);
+            perror("RenderCoordinator: exec");
+            _exit(1);
+        }
+        m_children.push_back(pid);
+    }
+    std::cout << "Spawned " << m_children.size() << " workers" << std::endl;
+}
+
+bool
+RenderCoordinator::workersAlive()
+{
+    // only spawned workers can be checked, remote ones may still come
+    if (options.spawnWorkers <= 0 || !m_clients.empty())
+        return true;
+    for (size_t i=0; i<m_children.size(); )
+    {
+        if (waitpid(m_children[i], NULL, WNOHANG) == m_children[i])
+            m_children.erase(m_children.begin()+i);
+        else
+            i++;
+    }
+    return !m_children.empty();
+}
+
+bool
+RenderCoordinator::sendPhotons(Client &client)
+{
+    FILE *file = fopen(options.photonFile.c_str(), "rb");
+    if (file == NULL)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    bool ok = client.socket.sendAll(&size, sizeof(size));
+    std::vector<char> buffer(1 << 20);
+    while (ok && size > 0)
+    {
+        size_t n = fread(&buffer[0], 1, buffer.size(), file);
+        ok = n > 0 && client.socket.sendAll(&buffer[0], n);
+        size -= n;
+    }
+    fclose(file);
+    return ok;
+}
+
+bool
+RenderCoordinator::handleMessage(Client &client, Util::Array2D<Math::Color4f> &image)
+{
+    int type;
+    if (!client.socket.recvInt(type))
+        return false;
+    
+    switch (type)
+    {
+        case MSG_HELLO:
+            return client.socket.sendInt(MSG_CONFIG) &&
+                   client.socket.sendString(options.scene) &&
+                   client.socket.sendInt(options.width) &&
+                   client.socket.sendInt(options.height) &&
+                   client.socket.sendInt(options.spp) &&
+                   client.socket.sendInt(scene._monteCarloSamples) &&
+                   client.socket.sendAll(&scene.seed, sizeof(scene.seed)) &&
+                   client.socket.sendInt(int(scene.sampler)) &&
+                   client.socket.sendString(options.photonFile) &&
+                   client.socket.sendAll(&m_photonSize, sizeof(m_photonSize)) &&
+                   client.socket.sendAll(&m_photonChecksum, sizeof(m_photonChecksum));
+        case MSG_PHOTONS:
+            return sendPhotons(client);
+        case MSG_REQUEST:
+            client.waiting = true;
+            return true;
+        case MSG_RESULT:
+        {
+            TileScheduler::Tile tile;
+            if (!client.socket.recvAll(&tile, sizeof(tile)) || !client.busy ||
+                tile.x0 != client.tile.x0 || tile.y0 != client.tile.y0 ||
+                tile.x1 != client.tile.x1 || tile.y1 != client.tile.y1)
+                return false;
+            std::vector<Math::Color4f> pixels((tile.x1-tile.x0)*(tile.y1-tile.y0));
+            if (!client.socket.recvAll(&pixels[0], pixels.size()*sizeof(Math::Color4f)))
+                return false;
+            size_t k = 0;
+            for (int j=tile.y0; j<tile.y1; j++)
+                for (int i=tile.x0; i<tile.x1; i++)
+                    image(i, j) = pixels[k++];
+            client.busy = false;
+            m_completed++;
+            return true;
+        }
+        default:
+            std::cerr << "RenderCoordinator: unexpected message " << type << std::endl;
+            return false;
+    }
+}
+
+void
+RenderCoordinator::disconnect(size_t index)
+{
+    Client *client = m_clients[index];
+    if (client->busy)
+    {
+        // somebody else has to render it
+        m_pending.push_front(client->tile);
+    }
+    delete client;
+    m_clients.erase(m_clients.begin()+index);
+    std::cout << "Worker disconnected, " << m_clients.size() << " left" << std::endl;
+}
+
+bool
+RenderCoordinator::run(Util::Array2D<Math::Color4f> &image)
+{
+    const int xRes = options.width;
+    const int yRes = options.height;
+    
+    // 1. Photons are traced once and shared through a file
+    if (scene.photonMap == NULL && scene.specularPhotonMap == NULL)
+    {
+        scene.emit_scatterPhotons();
+    }
+    if (!scene.savePhotonMaps(options.photonFile) ||
+        !fileChecksum(options.photonFile, m_photonSize, m_photonChecksum))
+    {
+        return false;
+    }
+    
+    // 2. Workers connect to us
+    Platform::Socket server;
+    if (!server.listen(options.coordinatorPort))
+    {
+        return false;
+    }
+    std::cout << "Coordinator listening on port " << server.port() << std::endl;
+    spawnWorkers(server.port());
+    
+    // 3. Hand out the tiles
+    std::vector<TileScheduler::Tile> tiles = TileScheduler::tiles(xRes, yRes, scene.tileSize);
+    m_pending.assign(tiles.begin(), tiles.end());
+    const int total = int(m_pending.size());
+    image.resizeErase(xRes, yRes);
+    image.reset(Math::Color4f(0.0f));
+    m_completed = 0;
+    
+    Platform::Stopwatch timer;
+    timer.start();
+    Platform::Progress progress("Distributed rendering", total);
+    while (m_completed < total)
+    {
+        std::vector<pollfd> fds(m_clients.size()+1);
+        fds[0].fd = server.fd();
+        fds[0].events = POLLIN;
+        for (size_t c=0; c<m_clients.size(); c++)
+        {
+            fds[c+1].fd = m_clients[c]->socket.fd();
+            fds[c+1].events = POLLIN;
+        }
+        if (poll(&fds[0], fds.size(), 1000) == 0)
+        {
+            if (!workersAlive())
+            {
+                std::cerr << "RenderCoordinator: all workers exited" << std::endl;
+                return false;
+            }
+            continue;
+        }
+        
+        // answer the connected clients first, fds and m_clients match
+        int before = m_completed;
+        for (size_t c=m_clients.size(); c-- > 0; )
+        {
+            if (fds[c+1].revents == 0)
+                continue;
+            if (!handleMessage(*m_clients[c], image))
+                disconnect(c);
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            Client *client = new Client();
+            client->busy = false;
+            client->waiting = false;
+            if (server.accept(client->socket))
+                m_clients.push_back(client);
+            else
+                delete client;
+        }
+        
+        for (size_t c=0; c<m_clients.size() && !m_pending.empty(); )
+        {
+            Client &client = *m_clients[c];
+            if (!client.waiting || client.busy)
+            {
+                c++;
+                continue;
+            }
+            client.tile = m_pending.front();
+            client.waiting = false;
+            client.busy = true;
+            m_pending.pop_front();
+            if (client.socket.sendInt(MSG_TILE) &&
+                client.socket.sendAll(&client.tile, sizeof(client.tile)))
+                c++;
+            else
+                disconnect(c);
+        }
+        progress.step(m_completed-before);
+    }
+    progress.done();
+    timer.stop();
+    std::cout << "Distributed rendering took " << timer.elapsedSeconds() << "s" << std::endl;
+    
+    for (Client *client: m_clients)
+    {
+        client->socket.sendInt(MSG_DONE);
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Worker
+
+RenderWorker::RenderWorker(const BatchOptions &options):
+    options(options),
+    scene(),
+    sceneLoader(scene)
+{
+    
+}
+
+bool
+RenderWorker::receivePhotons(const std::string &filename)
+{
+    long long size;
+    if (!socket.sendInt(MSG_PHOTONS) || !socket.recvAll(&size, sizeof(size)))
+        return false;
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    
+    bool ok = true;
+    std::vector<char> buffer(1 << 20);
+    while (ok && size > 0)
+    {
+        size_t n = std::min<long long>(size, buffer.size());
+        ok = socket.recvAll(&buffer[0], n) &&
+             fwrite(&buffer[0], 1, n, file) == n;
+        size -= n;
+    }
+    fclose(file);
+    return ok;
+}
+
+bool
+RenderWorker::configure()
+{
+    int type, sampler;
+    long long photonSize;
+    uint64_t photonChecksum;
+    if (!socket.sendInt(MSG_HELLO) ||
+        !socket.recvInt(type) || type != MSG_CONFIG ||
+        !socket.recvString(options.scene) ||
+        !socket.recvInt(options.width) ||
+        !socket.recvInt(options.height) ||
+        !socket.recvInt(options.spp) ||
+        !socket.recvInt(options.gatherSamples) ||
+        !socket.recvAll(&options.seed, sizeof(options.seed)) ||
+        !socket.recvInt(sampler) ||
+        !socket.recvString(options.photonFile) ||
+        !socket.recvAll(&photonSize, sizeof(photonSize)) ||
+        !socket.recvAll(&photonChecksum, sizeof(photonChecksum)))
+    {
+        std::cerr << "RenderWorker: handshake failed" << std::endl;
+        return false;
+    }
+    
+    if (!sceneLoader.loadScene(options.scene))
+    {
+        return false;
+    }
+    scene.camera.setResolution(options.width, options.height);
+    scene.seed = options.seed;
+    options.sampler = SamplerType(sampler);
+    scene.sampler = options.sampler;
+    scene._monteCarloSamples = options.gatherSamples;
+    scene.renderThreads = options.threads;
+#ifdef _OPENMP
+    if (options.threads > 0)
+    {
+        omp_set_num_threads(options.threads);
+    }
+#endif
+    
+    // A file of the same name is only used if it is the coordinator's,
+    // it may as well be left over from another render. Without a shared
+    // file system the photons come over the socket.
+    long long size;
+    uint64_t checksum;
+    if (fileChecksum(options.photonFile, size, checksum) &&
+        size == photonSize && checksum == photonChecksum)
+    {
+        return scene.loadPhotonMaps(options.photonFile);
+    }
+    std::stringstream local;
+    local << options.photonFile << "." << getpid();
+    bool ok = receivePhotons(local.str()) &&
+              fileChecksum(local.str(), size, checksum) &&
+              size == photonSize && checksum == photonChecksum &&
+              scene.loadPhotonMaps(local.str());
+    remove(local.str().c_str());
+    if (!ok)
+    {
+        std::cerr << "RenderWorker: could not receive the photon maps" << std::endl;
+    }
+    return ok;
+}
+
+int
+RenderWorker::run()
+{
+    size_t colon = options.workerAddress.rfind(':');
+    if (colon == std::string::npos)
+    {
+        std::cerr << "RenderWorker: expected HOST:PORT, got " << options.workerAddress << std::endl;
+        return -1;
+    }
+    std::string host = options.workerAddress.substr(0, colon);
+    int port = atoi(options.workerAddress.substr(colon+1).c_str());
+    if (!socket.connect(host, port) || !configure())
+    {
+        return -1;
+    }
+    
+    PhotonMapper renderer;
+    int tiles = 0;
+    for (;;)
+    {
+        int type;
+        if (!socket.sendInt(MSG_REQUEST) || !socket.recvInt(type))
+        {
+            std::cerr << "RenderWorker: lost the coordinator" << std::endl;
+            return -1;
+        }
+        if (type == MSG_DONE)
+        {
+            break;
+        }
+        TileScheduler::Tile tile;
+        if (type != MSG_TILE || !socket.recvAll(&tile, sizeof(tile)))
+        {
+            std::cerr << "RenderWorker: unexpected message " << type << std::endl;
+            return -1;
+        }
+        
+        renderer.renderTile(scene, tile, options.spp);
+        std::vector<Math::Color4f> pixels;
+        pixels.reserve((tile.x1-tile.x0)*(tile.y1-tile.y0));
+        for (int j=tile.y0; j<tile.y1; j++)
+            for (int i=tile.x0; i<tile.x1; i++)
+                pixels.push_back(renderer.image()(i, j));
+        if (!socket.sendInt(MSG_RESULT) ||
+            !socket.sendAll(&tile, sizeof(tile)) ||
+            !socket.sendAll(&pixels[0], pixels.size()*sizeof(Math::Color4f)))
+        {
+            std::cerr << "RenderWorker: lost the coordinator" << std::endl;
+            return -1;
+        }
+        tiles++;
+    }
+    std::cout << "RenderWorker: rendered " << tiles << " tiles" << std::endl;
+    return 0;
+}
@@ -0,0 +1,88 @@
+//
+//  DistributedRenderer.h
+//  RaytracerV3
+//
+//  Renders one frame with several processes: the coordinator traces the
+//  photons once, writes them to a file and hands out image tiles over
+//  TCP. Workers load the scene and the photon maps (from the shared file
+//  if their copy matches the coordinator's, otherwise over the socket),
+//  render the tiles they are given and send the pixels back.
+//
+
+#ifndef __RaytracerV3__DistributedRenderer__
+#define __RaytracerV3__DistributedRenderer__
+
+#include <vector>
+#include <deque>
+#include <sys/types.h>
+#include <stdint.h>
+#include "BatchRenderer.h"
+#include "TileScheduler.h"
+#include "Platform/Socket.h"
+#include "Util/Array2D.h"
+
+namespace Main {
+
+    // Every message starts with its type (an int), followed by the
+    // payload noted here.
+    enum RenderMessage {
+        MSG_HELLO,      // worker: -
+        MSG_CONFIG,     // coordinator: scene, width, height, spp, gather, seed (uint64_t),
+                        // sampler, photon file, its size (long long) and
+                        // FNV-1a hash (uint64_t)
+        MSG_PHOTONS,    // worker: -, coordinator: file size (long long), file contents
+        MSG_REQUEST,    // worker: -
+        MSG_TILE,       // coordinator: x0, y0, x1, y1
+        MSG_RESULT,     // worker: x0, y0, x1, y1, RGBA floats row by row
+        MSG_DONE        // coordinator: -
+    };
+    
+    class RenderCoordinator
+    {
+        struct Client
+        {
+            Platform::Socket socket;
+            bool busy;                  // a tile is assigned
+            bool waiting;               // asked for a tile
+            TileScheduler::Tile tile;
+        };
+        
+        Scene &scene;
+        const BatchOptions &options;
+        std::deque<TileScheduler::Tile> m_pending;
+        std::vector<Client*> m_clients;
+        std::vector<pid_t> m_children;
+        int m_completed;
+        long long m_photonSize;         // of options.photonFile
+        uint64_t m_photonChecksum;
+        
+        void spawnWorkers(int port);
+        bool workersAlive();
+        bool handleMessage(Client &client, Util::Array2D<Math::Color4f> &image);
+        bool sendPhotons(Client &client);
+        void disconnect(size_t index);
+    public:
+        RenderCoordinator(Scene &scene, const BatchOptions &options);
+        ~RenderCoordinator();
+        
+        // Traces the photons and serves tiles until image is complete
+        bool run(Util::Array2D<Math::Color4f> &image);
+    };
+    
+    class RenderWorker
+    {
+        BatchOptions options;
+        Scene scene;
+        SceneLoader sceneLoader;
+        Platform::Socket socket;
+        
+        bool configure();
+        bool receivePhotons(const std::string &filename);
+    public:
+        // options.workerAddress is HOST:PORT of the coordinator
+        RenderWorker(const BatchOptions &options);
+        int run();
+    };
+    
+};
+#endif /* defined(__RaytracerV3__DistributedRenderer__) */
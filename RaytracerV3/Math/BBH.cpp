@@ -7,9 +7,12 @@
 #endif // HAVE_CONFIG_H
 
 #include "BBH.h"
+#ifndef RAYTRACER_HEADLESS
 #include "MathGL.h"
+#endif
 #include "../Platform/Progress.h"
 #include <sstream>
+#include <iomanip>
 
 using namespace Platform;
 using std::min;
@@ -146,6 +149,7 @@ BBH::Node::freeMemory()
 void
 BBH::Node::renderGL() const
 {
+#ifndef RAYTRACER_HEADLESS
     Math::Vec3d e = bbox.max - bbox.min;
     glBegin(GL_LINE_LOOP);
         glVertex(bbox.min);
@@ -183,6 +187,7 @@ BBH::Node::renderGL() const
         glVertex(bbox.max - Math::Vec3d(e.x, 0.0f, e.z));
         glVertex(bbox.max - Math::Vec3d(e.x, 0.0f, 0.0f));
     glEnd();
+#endif
 }
 
 
@@ -0,0 +1,64 @@
+/*! \file Frame.h
+    \brief Contains an orthonormal basis for local shading coordinates.
+*/
+#ifndef MATH_FRAME_H
+#define MATH_FRAME_H
+
+#include "Vec3.h"
+#include <cmath>
+
+namespace Math
+{
+
+//! Orthonormal basis (s, t, n) around a unit vector n.
+/*!
+    Built without branches or trigonometry (Duff et al. 2017, "Building an
+    Orthonormal Basis, Revisited"), which is cheaper to set up and to apply
+    than a Mat44d from rotateTo(). Directions sampled around +z, e.g. by
+    Warp::cosineHemisphere, map to world space with toWorld().
+*/
+struct Frame
+{
+    Vec3d s;
+    Vec3d t;
+    Vec3d n;
+
+    Frame() {}
+    explicit Frame(const Vec3d& normal);
+
+    //! Maps v = (x, y, z) in local coordinates to x*s + y*t + z*n.
+    Vec3d toWorld(const Vec3d& v) const;
+
+    //! Inverse of toWorld().
+    Vec3d toLocal(const Vec3d& v) const;
+};
+
+
+inline
+Frame::Frame(const Vec3d& normal) :
+    n(normal)
+{
+    const double sign = std::copysign(1.0, n.z);
+    const double a = -1.0/(sign+n.z);
+    const double b = n.x*n.y*a;
+    s = Vec3d(1.0+sign*n.x*n.x*a, sign*b, -sign*n.x);
+    t = Vec3d(b, sign+n.y*n.y*a, -n.y);
+}
+
+inline Vec3d
+Frame::toWorld(const Vec3d& v) const
+{
+    return Vec3d(s.x*v.x + t.x*v.y + n.x*v.z,
+                 s.y*v.x + t.y*v.y + n.y*v.z,
+                 s.z*v.x + t.z*v.y + n.z*v.z);
+}
+
+inline Vec3d
+Frame::toLocal(const Vec3d& v) const
+{
+    return Vec3d(s.dot(v), t.dot(v), n.dot(v));
+}
+
+} // namespace Math
+
+#endif // MATH_FRAME_H
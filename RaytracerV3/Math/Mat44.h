@@ -863,7 +863,7 @@ Mat44<T>::operator!=(const Mat44 & m) const
            cols[0][2] != m[0][2] ||
            cols[0][3] != m[0][3] ||
            cols[1][0] != m[1][0] ||
-           cols[1][1] != m[1][2] ||
+           cols[1][1] != m[1][1] ||
            cols[1][2] != m[1][2] ||
            cols[1][3] != m[1][3] ||
            cols[2][0] != m[2][0] ||
@@ -0,0 +1,82 @@
+/*! \file PCG.h
+    \brief Contains the PCG32 pseudo-random number generator.
+*/
+#ifndef MATH_PCG_H
+#define MATH_PCG_H
+
+#include <stdint.h>
+
+namespace Math
+{
+
+//! PCG32 pseudo-random number generator (O'Neill 2014).
+/*!
+    64 bits of state and 2^63 independent streams, selected by the
+    sequence argument of seed(). Seeding is cheap, so renderers can start
+    a new stream for every pixel and sample. The class is a POD without
+    constructors so that it can be stored thread locally.
+*/
+struct PCG32
+{
+    uint64_t state;
+    uint64_t inc;               //!< Stream selector, always odd
+
+    //! Starts stream \a sequence at position \a initState.
+    void seed(uint64_t initState, uint64_t sequence);
+
+    //! Uniform integer in the range [0, 2^32-1].
+    uint32_t nexti();
+
+    //! Uniform float in the range [0.0f, 1.0f).
+    float nextf();
+
+    //! Uniform double in the range [0.0, 1.0).
+    double nextd();
+
+    //! Uniform double in the range [\a min, \a max).
+    double nextd(double min, double max);
+};
+
+
+inline void
+PCG32::seed(uint64_t initState, uint64_t sequence)
+{
+    state = 0u;
+    inc = (sequence << 1u) | 1u;
+    nexti();
+    state += initState;
+    nexti();
+}
+
+inline uint32_t
+PCG32::nexti()
+{
+    uint64_t old = state;
+    state = old*6364136223846793005ULL + inc;
+    uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = uint32_t(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+inline float
+PCG32::nextf()
+{
+    // 24 bits, so that the result stays below 1.0f
+    return (nexti() >> 8)*(1.0f/16777216.0f);
+}
+
+inline double
+PCG32::nextd()
+{
+    return nexti()*(1.0/4294967296.0);
+}
+
+inline double
+PCG32::nextd(double min, double max)
+{
+    return min + (max-min)*nextd();
+}
+
+} // namespace Math
+
+#endif // MATH_PCG_H
@@ -7,5 +7,174 @@
 //
 
 #include "Warp.h"
+#include <algorithm>
 
 
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+namespace Math
+{
+    
+namespace
+{
+    // Taylor coefficients of sin and cos
+    const double S3 = -1.0/6.0;
+    const double S5 = 1.0/120.0;
+    const double S7 = -1.0/5040.0;
+    const double S9 = 1.0/362880.0;
+    const double C2 = -1.0/2.0;
+    const double C4 = 1.0/24.0;
+    const double C6 = -1.0/720.0;
+    const double C8 = 1.0/40320.0;
+    const double C10 = -1.0/3628800.0;
+    
+    static_assert(sizeof(Vec2d) == 2*sizeof(double), "Vec2d must be two packed doubles");
+    
+#ifdef __AVX__
+    // sin and cos of 2*pi*t for four values of t, the same steps as
+    // Warp::sinCos2Pi
+    inline void
+    sinCos2Pi4(__m256d t, __m256d &s, __m256d &c)
+    {
+        const __m256d f = _mm256_mul_pd(t, _mm256_set1_pd(4.0));
+        const __m256d q = _mm256_floor_pd(f);
+        const __m256d a = _mm256_mul_pd(_mm256_sub_pd(_mm256_sub_pd(f, q), _mm256_set1_pd(0.5)),
+                                        _mm256_set1_pd(M_PI/2.0));
+        const __m256d a2 = _mm256_mul_pd(a, a);
+        
+        __m256d sa = _mm256_add_pd(_mm256_set1_pd(S7), _mm256_mul_pd(a2, _mm256_set1_pd(S9)));
+        sa = _mm256_add_pd(_mm256_set1_pd(S5), _mm256_mul_pd(a2, sa));
+        sa = _mm256_add_pd(_mm256_set1_pd(S3), _mm256_mul_pd(a2, sa));
+        sa = _mm256_add_pd(_mm256_set1_pd(1.0), _mm256_mul_pd(a2, sa));
+        sa = _mm256_mul_pd(a, sa);
+        
+        __m256d ca = _mm256_add_pd(_mm256_set1_pd(C8), _mm256_mul_pd(a2, _mm256_set1_pd(C10)));
+        ca = _mm256_add_pd(_mm256_set1_pd(C6), _mm256_mul_pd(a2, ca));
+        ca = _mm256_add_pd(_mm256_set1_pd(C4), _mm256_mul_pd(a2, ca));
+        ca = _mm256_add_pd(_mm256_set1_pd(C2), _mm256_mul_pd(a2, ca));
+        ca = _mm256_add_pd(_mm256_set1_pd(1.0), _mm256_mul_pd(a2, ca));
+        
+        const __m256d half = _mm256_set1_pd(M_SQRT1_2);
+        const __m256d sq = _mm256_mul_pd(_mm256_add_pd(sa, ca), half);
+        const __m256d cq = _mm256_mul_pd(_mm256_sub_pd(ca, sa), half);
+        
+        // quadrant q mod 4
+        const __m256d q4 = _mm256_sub_pd(q, _mm256_mul_pd(_mm256_floor_pd(_mm256_mul_pd(q, _mm256_set1_pd(0.25))),
+                                                          _mm256_set1_pd(4.0)));
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d three = _mm256_set1_pd(3.0);
+        const __m256d odd = _mm256_or_pd(_mm256_cmp_pd(q4, one, _CMP_EQ_OQ),
+                                         _mm256_cmp_pd(q4, three, _CMP_EQ_OQ));
+        const __m256d sinNeg = _mm256_cmp_pd(q4, _mm256_set1_pd(1.5), _CMP_GT_OQ);
+        const __m256d cosNeg = _mm256_and_pd(_mm256_cmp_pd(q4, _mm256_set1_pd(0.5), _CMP_GT_OQ),
+                                             _mm256_cmp_pd(q4, _mm256_set1_pd(2.5), _CMP_LT_OQ));
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        s = _mm256_xor_pd(_mm256_blendv_pd(sq, cq, odd), _mm256_and_pd(sinNeg, sign));
+        c = _mm256_xor_pd(_mm256_blendv_pd(cq, sq, odd), _mm256_and_pd(cosNeg, sign));
+    }
+    
+    // Splits four packed samples into their s and t components, in the
+    // lane order 0, 2, 1, 3
+    inline void
+    load(const Vec2d* samples, __m256d &s, __m256d &t)
+    {
+        const __m256d a = _mm256_loadu_pd(&samples[0].x);
+        const __m256d b = _mm256_loadu_pd(&samples[2].x);
+        s = _mm256_unpacklo_pd(a, b);
+        t = _mm256_unpackhi_pd(a, b);
+    }
+    
+    inline void
+    store(Vec3d* v, __m256d x, __m256d y, __m256d z)
+    {
+        static const int sample[4] = {0, 2, 1, 3};
+        double px[4], py[4], pz[4];
+        _mm256_storeu_pd(px, x);
+        _mm256_storeu_pd(py, y);
+        _mm256_storeu_pd(pz, z);
+        for (int k=0; k<4; k++)
+        {
+            v[sample[k]] = Vec3d(px[k], py[k], pz[k]);
+        }
+    }
+#endif
+}
+
+void
+Warp::sinCos2Pi(double t, double* s, double* c)
+{
+    const double f = 4.0*t;
+    const double q = floor(f);
+    // angle within the quadrant minus pi/4
+    const double a = (f-q-0.5)*(M_PI/2.0);
+    const double a2 = a*a;
+    const double sa = a*(1.0+a2*(S3+a2*(S5+a2*(S7+a2*S9))));
+    const double ca = 1.0+a2*(C2+a2*(C4+a2*(C6+a2*(C8+a2*C10))));
+    const double sq = (sa+ca)*M_SQRT1_2;
+    const double cq = (ca-sa)*M_SQRT1_2;
+    
+    switch (int(q-floor(q*0.25)*4.0))
+    {
+        case 0: *s = sq;  *c = cq;  break;
+        case 1: *s = cq;  *c = -sq; break;
+        case 2: *s = -sq; *c = -cq; break;
+        default: *s = -cq; *c = sq; break;
+    }
+}
+
+void
+Warp::cosineHemisphereBatch(Vec3d* v, const Vec2d* samples, int count)
+{
+    int i = 0;
+#ifdef __AVX__
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    for (; i+4 <= count; i += 4)
+    {
+        __m256d s, t, sinPhi, cosPhi;
+        load(samples+i, s, t);
+        sinCos2Pi4(t, sinPhi, cosPhi);
+        const __m256d r = _mm256_sqrt_pd(s);
+        const __m256d z = _mm256_sqrt_pd(_mm256_max_pd(zero, _mm256_sub_pd(one, s)));
+        store(v+i, _mm256_mul_pd(r, cosPhi), _mm256_mul_pd(r, sinPhi), z);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        double sinPhi, cosPhi;
+        sinCos2Pi(samples[i].y, &sinPhi, &cosPhi);
+        const double r = sqrt(samples[i].x);
+        v[i] = Vec3d(r*cosPhi, r*sinPhi, sqrt(std::max(0.0, 1.0-samples[i].x)));
+    }
+}
+
+void
+Warp::uniformSphereBatch(Vec3d* v, const Vec2d* samples, int count)
+{
+    int i = 0;
+#ifdef __AVX__
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    for (; i+4 <= count; i += 4)
+    {
+        __m256d s, t, sinPhi, cosPhi;
+        load(samples+i, s, t);
+        sinCos2Pi4(s, sinPhi, cosPhi);
+        const __m256d h = _mm256_sub_pd(_mm256_add_pd(t, t), one);
+        const __m256d a = _mm256_sqrt_pd(_mm256_max_pd(zero, _mm256_sub_pd(one, _mm256_mul_pd(h, h))));
+        store(v+i, _mm256_mul_pd(a, sinPhi), _mm256_mul_pd(a, cosPhi), h);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        double sinPhi, cosPhi;
+        sinCos2Pi(samples[i].x, &sinPhi, &cosPhi);
+        const double h = 2.0*samples[i].y-1.0;
+        const double a = sqrt(std::max(0.0, 1.0-h*h));
+        v[i] = Vec3d(a*sinPhi, a*cosPhi, h);
+    }
+}
+    
+} // namespace Math
@@ -12,6 +12,8 @@
 namespace Math
 {
 
+    //! Maximum absolute error per component of the batched mappings
+    const double WARP_BATCH_MAX_ERROR = 1e-8;
     
     enum WarpFunction {
         UNIFORM_SQUARE,
@@ -103,6 +105,23 @@ public:
     static void  phongHemisphere(Vec3d* v, double s, double t, double n);
     static double phongHemispherePdf(const Vec3d& v, double n);
     //@}
+
+    //-----------------------------------------------------------------------
+    //@{ \name Batched mappings.
+    //-----------------------------------------------------------------------
+    //! Map count samples at once, four at a time with AVX if the compiler
+    //! targets it (-march=corei7-avx), otherwise one at a time with the
+    //! same arithmetic. sin and cos are approximated by polynomials, the
+    //! directions differ from the exact mapping by less than
+    //! WARP_BATCH_MAX_ERROR per component (checked by the warp-test CTest,
+    //! Tests/WarpTest.cpp).
+    static void  cosineHemisphereBatch(Vec3d* v, const Vec2d* samples, int count);
+    static void  uniformSphereBatch(Vec3d* v, const Vec2d* samples, int count);
+    
+    //! Fast sin and cos of 2*pi*t: quadrant reduction and Taylor polynomials
+    //! of degree 9 and 10 on [-pi/4, pi/4], absolute error below 2e-9.
+    static void  sinCos2Pi(double t, double* s, double* c);
+    //@}
     
     // Warp Point
     static void warpPoint(double s, double t, Vec3d& v, WarpFunction warpFunction);
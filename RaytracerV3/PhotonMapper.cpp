@@ -7,17 +7,40 @@
 //
 
 #include "PhotonMapper.h"
+#ifndef RAYTRACER_HEADLESS
 #include <OpenGL/OpenGL.h>
+#endif
 #include "Platform/Progress.h"
+#include "Platform/Stopwatch.h"
+#include "TileScheduler.h"
 #include "PhotonSource.h"
 #include "PhotonMap.h"
 #include "Shape.h"
 #include "Math/LineAlgo.h"
+#include "Octree.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+
+namespace
+{
+    // the beam query results of the calling thread, created on first use
+    // and kept for the lifetime of the thread (OpenMP reuses its workers)
+    __thread std::vector<BeamPhoton> *t_beamPhotons = NULL;
+}
 
 PhotonMapper::PhotonMapper():
-    m_fbo(FrameBuffer(GL_TEXTURE_2D, 512, 512, -1, GL_RGBA32F_ARB, 1, 1, 0, "PhotonMapper FBO"))
+#ifndef RAYTRACER_HEADLESS
+    m_fbo(FrameBuffer(GL_TEXTURE_2D, 512, 512, -1, GL_RGBA32F_ARB, 1, 1, 0, "PhotonMapper FBO")),
+#endif
+    m_stream(NULL),
+    m_passes(0),
+    m_previewLevel(-1)
 {
+#ifndef RAYTRACER_HEADLESS
     m_fbo.checkFramebufferStatus(1);
+#endif
 }
 
 PhotonMapper::~PhotonMapper()
@@ -30,15 +53,18 @@ void
 PhotonMapper::setRes(int x, int y)
 {
 	m_rgbaBuffer.resizeErase(x, y);
-	m_fbo.resizeExistingFBO(x, y);
 	
 	// clear the buffers
 	m_rgbaBuffer = Math::Vec4f(0.0f);
 	
+#ifndef RAYTRACER_HEADLESS
+	m_fbo.resizeExistingFBO(x, y);
+	
 	// Upload a blank texture to the FBO
 	glBindTexture(GL_TEXTURE_2D, m_fbo.colorTextureID(0));
 	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_fbo.width(), m_fbo.height(), GL_RGBA, GL_FLOAT, &m_rgbaBuffer(0,0));
 	glBindTexture(GL_TEXTURE_2D, 0);
+#endif
 }
 
 void
@@ -50,35 +76,425 @@ PhotonMapper::render(Scene &scene)
     
 	//clear m_rgbaBuffer
     m_rgbaBuffer.reset(Math::Color4f(1.0,1,1,1.0));
-	//setup progress reporting using Platform::Progress
+    
+    TileScheduler::Tile image = {0, 0, xRes, yRes};
+    renderRegion(scene, image);
+    if (scene.denoise)
+    {
+        denoise(scene);
+        display();
+    }
+//    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    
+//    m_fbo.displayAlphaAsFullScreenTexture(FBO_COLOR0);
+
+}
+
+void
+PhotonMapper::renderRegion(Scene &scene, const TileScheduler::Tile &region)
+{
+    int xRes = scene.camera.xRes();
+    int yRes = scene.camera.yRes();
+    if (m_rgbaBuffer.sizeX() != xRes || m_rgbaBuffer.sizeY() != yRes)
+    {
+        // nothing to composite over
+        setRes(xRes, yRes);
+    }
+    m_passes = 0;
+    
+    const int x0 = std::max(region.x0, 0);
+    const int y0 = std::max(region.y0, 0);
+    const int x1 = std::min(region.x1, xRes);
+    const int y1 = std::min(region.y1, yRes);
+    if (x1 <= x0 || y1 <= y0)
+    {
+        return;
+    }
     
 	//for each pixel generate a camera ray
+    if (scene.photonMap == NULL && scene.specularPhotonMap == NULL) {
+        scene.emit_scatterPhotons();
+    }
+    Platform::Stopwatch timer;
+    timer.start();
+    Platform::Progress progress = Platform::Progress("Raytracing Image", (x1-x0)*(y1-y0));
+    
+    // rows are streamed once all their tiles are done
+    ImageStream *stream = (x1-x0 == xRes && y1-y0 == yRes) ? m_stream : NULL;
+    std::vector<std::atomic<int> > rowPixels(stream != NULL ? yRes : 0);
+    for (size_t j=0; j<rowPixels.size(); j++)
+        rowPixels[j] = 0;
+    
+    TileScheduler scheduler(x1-x0, y1-y0, scene.tileSize, scene.renderThreads);
+    scheduler.run([&](const TileScheduler::Tile &tile) {
+        for (int j=y0+tile.y0; j<y0+tile.y1; j++) {
+            for (int i=x0+tile.x0; i<x0+tile.x1; i++) {
+                scene.seedPixel(i, j, 0);
+                Ray r = Ray();
+                scene.camera.generateRay(r, i, j);
+                Math::Vec3f col = recursiveRender(r, *(scene.photonMap), *(scene.specularPhotonMap), scene, true);
+                m_rgbaBuffer(i, j) = Math::Vec4f(col.x, col.y, col.z, 1.0);
+            }
+            if (stream != NULL && (rowPixels[j] += tile.x1-tile.x0) == xRes)
+                stream->addRow(m_rgbaBuffer, j);
+        }
+        #pragma omp critical
+        progress.step((tile.x1-tile.x0)*(tile.y1-tile.y0));
+    });
+    timer.stop();
+    std::cout << "Raytracing took " << timer.elapsedSeconds() << "s" << std::endl;
+	
+	//Copy the final rendering to the texture
+    display();
+}
+
+void
+PhotonMapper::renderPass(Scene &scene)
+{
+    int xRes = scene.camera.xRes();
+    int yRes = scene.camera.yRes();
+    if (m_passes == 0 || m_rgbaBuffer.sizeX() != xRes || m_rgbaBuffer.sizeY() != yRes)
+    {
+        setRes(xRes, yRes);
+        m_passes = 0;
+    }
     
     if (scene.photonMap == NULL && scene.specularPhotonMap == NULL) {
         scene.emit_scatterPhotons();
     }
-    Platform::Progress progress = Platform::Progress("Raytracing Image", xRes*yRes);    
-    for (int i=0; i < xRes; i++) {
+    
+    // the first pass samples the pixel centers, later ones are jittered
+    const bool jitter = m_passes > 0;
+    const float weight = 1.0f/(m_passes+1);
+    TileScheduler scheduler(xRes, yRes, scene.tileSize, scene.renderThreads);
+    scheduler.run([&](const TileScheduler::Tile &tile) {
+        for (int j=tile.y0; j<tile.y1; j++) {
+            for (int i=tile.x0; i<tile.x1; i++) {
+                scene.seedPixel(i, j, m_passes);
+                double x = i, y = j;
+                if (jitter) {
+                    Math::Vec2d offset = scene.pixelJitter(i, j, m_passes);
+                    x += offset.x;
+                    y += offset.y;
+                }
+                Ray r = Ray();
+                scene.camera.generateRay(r, x, y);
+                Math::Vec3f col = recursiveRender(r, *(scene.photonMap), *(scene.specularPhotonMap), scene, true);
+                Math::Vec4f &mean = m_rgbaBuffer(i, j);
+                mean += (Math::Vec4f(col.x, col.y, col.z, 1.0)-mean)*weight;
+            }
+        }
+    });
+    m_passes++;
+    
+    display();
+    std::cout << "Progressive pass " << m_passes << std::endl;
+}
+
+void
+PhotonMapper::setImage(const Util::Array2D<Math::Color4f> &image)
+{
+    setRes(image.sizeX(), image.sizeY());
+    for (int j=0; j<image.sizeY(); j++) {
+        for (int i=0; i<image.sizeX(); i++) {
+            m_rgbaBuffer(i, j) = image(i, j);
+        }
+    }
+}
 
+bool
+PhotonMapper::renderPreview(Scene &scene)
+{
+    const int coarsest = 3;
+    int xRes = scene.camera.xRes();
+    int yRes = scene.camera.yRes();
+    if (m_previewLevel < 0 ||
+        m_rgbaBuffer.sizeX() != xRes || m_rgbaBuffer.sizeY() != yRes ||
+        m_previewCamera != scene.camera.cameraToWorld())
+    {
+        setRes(xRes, yRes);
+        m_previewLevel = coarsest;
+        m_previewCamera = scene.camera.cameraToWorld();
+    }
+    if (scene.photonMap == NULL && scene.specularPhotonMap == NULL) {
+        scene.emit_scatterPhotons();
+    }
+    
+    const int level = m_previewLevel;
+    const int step = 1 << level;
+    Platform::Stopwatch timer;
+    timer.start();
+    
+    // trace the pixels on this level's grid that no coarser level traced
+    TileScheduler scheduler(xRes, yRes, scene.tileSize, scene.renderThreads);
+    scheduler.run([&](const TileScheduler::Tile &tile) {
+        for (int j=tile.y0; j<tile.y1; j++) {
+            if (j % step != 0)
+                continue;
+            for (int i=tile.x0; i<tile.x1; i++) {
+                if (i % step != 0)
+                    continue;
+                if (level < coarsest && i % (2*step) == 0 && j % (2*step) == 0)
+                    continue;
+                scene.seedPixel(i, j, 0);
+                Math::Vec3f col = samplePixel(scene, i, j);
+                m_rgbaBuffer(i, j) = Math::Vec4f(col.x, col.y, col.z, 1.0);
+            }
+        }
+    });
+    
+    // fill the rest with the nearest traced sample
+    if (step > 1) {
         #pragma omp parallel for
         for (int j=0; j<yRes; j++) {
-            Ray r = Ray();
-            scene.camera.generateRay(r, i, j);
-            Math::Vec3f col = recursiveRender(r, *(scene.photonMap), *(scene.specularPhotonMap), scene, true);
-            m_rgbaBuffer(i, j) = Math::Vec4f(col.x, col.y, col.z, 1.0);
+            for (int i=0; i<xRes; i++) {
+                if (i % step != 0 || j % step != 0)
+                    m_rgbaBuffer(i, j) = m_rgbaBuffer(i-i%step, j-j%step);
+            }
         }
-        progress.step(yRes);
     }
-	
-	//Copy the final rendering to the texture
+    timer.stop();
+    std::cout << "Preview 1/" << step << " took " << timer.elapsedSeconds() << "s" << std::endl;
+    
+    m_previewLevel--;
+    if (m_previewLevel < 0 && scene.denoise)
+    {
+        denoise(scene);
+    }
+    display();
+    return m_previewLevel < 0;
+}
+
+void
+PhotonMapper::denoise(const Scene &scene)
+{
+    Platform::Stopwatch timer;
+    timer.start();
+    m_denoiser.iterations = scene.denoiseIterations;
+    m_denoiser.captureFeatures(scene);
+    m_denoiser.filter(m_rgbaBuffer, scene.renderThreads);
+    timer.stop();
+    std::cout << "Denoising took " << timer.elapsedSeconds() << "s" << std::endl;
+}
+
+int
+PhotonMapper::renderTimed(Scene &scene, double budget, int minPasses)
+{
+    Platform::Stopwatch clock;
+    clock.start();
+    
+    if (scene.photonMap == NULL && scene.specularPhotonMap == NULL)
+    {
+        // Trace a fraction of the photons first to measure their cost,
+        // then as many as fit into the photon share of the budget.
+        const double photonBudget = budget*scene.timeBudgetPhotonShare;
+        const double pilot = 1.0/8.0;
+        const double scale = scene.photonScale;
+        scene.photonScale = scale*pilot;
+        scene.emit_scatterPhotons();
+        const double pilotTime = clock.elapsedSeconds();
+        
+        double fraction = 1.0;
+        if (pilotTime > 0.0)
+        {
+            fraction = std::min((photonBudget-pilotTime)*pilot/pilotTime, 1.0);
+        }
+        if (fraction > pilot)
+        {
+            scene.clearPhotonMaps();
+            scene.photonScale = scale*fraction;
+            scene.emit_scatterPhotons();
+        }
+        else
+        {
+            fraction = pilot;
+        }
+        scene.photonScale = scale;
+        std::cout << "Traced " << 100.0*fraction << "% of the photons in "
+                  << clock.elapsedSeconds() << "s" << std::endl;
+    }
+    
+    resetAccumulation();
+    double slowest = 0.0;
+    while (m_passes < minPasses || clock.elapsedSeconds()+slowest <= budget)
+    {
+        Platform::Stopwatch pass;
+        pass.start();
+        renderPass(scene);
+        pass.stop();
+        slowest = std::max(slowest, pass.elapsedSeconds());
+    }
+    clock.stop();
+    if (clock.elapsedSeconds() > budget)
+    {
+        std::cout << "Time budget exceeded for " << minPasses
+                  << " samples per pixel" << std::endl;
+    }
+    return m_passes;
+}
+
+void
+PhotonMapper::renderTile(Scene &scene, const TileScheduler::Tile &tile, int spp)
+{
+    int xRes = scene.camera.xRes();
+    int yRes = scene.camera.yRes();
+    if (m_rgbaBuffer.sizeX() != xRes || m_rgbaBuffer.sizeY() != yRes)
+    {
+        setRes(xRes, yRes);
+    }
+    
+    const float weight = 1.0f/std::max(spp, 1);
+    TileScheduler scheduler(tile.x1-tile.x0, tile.y1-tile.y0, 8, scene.renderThreads);
+    scheduler.run([&](const TileScheduler::Tile &part) {
+        for (int j=tile.y0+part.y0; j<tile.y0+part.y1; j++) {
+            for (int i=tile.x0+part.x0; i<tile.x0+part.x1; i++) {
+                Math::Vec3f sum(0.0f);
+                for (int s=0; s<spp; s++) {
+                    scene.seedPixel(i, j, s);
+                    double x = i, y = j;
+                    if (s > 0) {
+                        Math::Vec2d offset = scene.pixelJitter(i, j, s);
+                        x += offset.x;
+                        y += offset.y;
+                    }
+                    sum += samplePixel(scene, x, y);
+                }
+                sum *= weight;
+                m_rgbaBuffer(i, j) = Math::Vec4f(sum.x, sum.y, sum.z, 1.0);
+            }
+        }
+    });
+}
+
+void
+PhotonMapper::PixelStats::add(const Math::Color3f &c)
+{
+    n++;
+    Math::Color3f delta = c-mean;
+    mean += delta/float(n);
+    Math::Color3f delta2 = c-mean;
+    m2 += Math::Color3f(delta.x*delta2.x, delta.y*delta2.y, delta.z*delta2.z);
+}
+
+float
+PhotonMapper::PixelStats::relativeError() const
+{
+    if (n < 2)
+        return std::numeric_limits<float>::max();
+    // variance of the mean of the noisiest channel
+    Math::Color3f var = m2/float(n*(n-1));
+    float sigma = sqrt(std::max(var.x, std::max(var.y, var.z)));
+    return sigma/std::max(mean.luminance(), 1e-2f);
+}
+
+Math::Vec3f
+PhotonMapper::samplePixel(Scene &scene, double x, double y) const
+{
+    Ray r = Ray();
+    scene.camera.generateRay(r, x, y);
+    return recursiveRender(r, *(scene.photonMap), *(scene.specularPhotonMap), scene, true);
+}
+
+void
+PhotonMapper::renderAdaptive(Scene &scene)
+{
+    int xRes = scene.camera.xRes();
+    int yRes = scene.camera.yRes();
+    setRes(xRes, yRes);
+    m_pixelStats.resizeErase(xRes, yRes);
+    
+    // the error estimate needs at least two samples per pixel
+    PixelStats initial;
+    initial.mean = Math::Color3f(0.0f);
+    initial.m2 = Math::Color3f(0.0f);
+    initial.n = 0;
+    initial.pending = std::max(scene.adaptiveMinSamples, 2);
+    m_pixelStats.reset(initial);
+    
+    if (scene.photonMap == NULL && scene.specularPhotonMap == NULL) {
+        scene.emit_scatterPhotons();
+    }
+    
+    const long pixels = long(xRes)*yRes;
+    const long budget = long(scene.adaptiveSamplesPerPixel*pixels);
+    const int batch = std::max(scene.adaptiveBatch, 1);
+    long used = 0;
+    long pending = pixels*initial.pending;
+    int round = 0;
+    
+    Platform::Stopwatch timer;
+    timer.start();
+    while (pending > 0)
+    {
+        // 1. Take the pending samples of every pixel
+        TileScheduler scheduler(xRes, yRes, scene.tileSize, scene.renderThreads);
+        scheduler.run([&](const TileScheduler::Tile &tile) {
+            for (int j=tile.y0; j<tile.y1; j++) {
+                for (int i=tile.x0; i<tile.x1; i++) {
+                    PixelStats &stats = m_pixelStats(i, j);
+                    for (int s=0; s<stats.pending; s++) {
+                        scene.seedPixel(i, j, stats.n);
+                        Math::Vec2d offset = scene.pixelJitter(i, j, stats.n);
+                        Math::Vec3f col = samplePixel(scene, i+offset.x, j+offset.y);
+                        stats.add(Math::Color3f(col.x, col.y, col.z));
+                    }
+                    stats.pending = 0;
+                }
+            }
+        });
+        used += pending;
+        round++;
+        
+        // 2. Rank the pixels above the threshold, the noisiest ones get
+        //    the rest of the budget first
+        std::vector<std::pair<float, int> > noisy;
+        for (int j=0; j<yRes; j++) {
+            for (int i=0; i<xRes; i++) {
+                float error = m_pixelStats(i, j).relativeError();
+                if (error > scene.adaptiveThreshold)
+                    noisy.push_back(std::make_pair(error, j*xRes+i));
+            }
+        }
+        std::cout << "Adaptive round " << round << ": " << noisy.size()
+                  << " pixels above threshold, " << used << "/" << budget
+                  << " samples" << std::endl;
+        
+        const long affordable = std::max(budget-used, 0L)/batch;
+        if (long(noisy.size()) > affordable) {
+            std::nth_element(noisy.begin(), noisy.begin()+affordable, noisy.end(),
+                             std::greater<std::pair<float, int> >());
+            noisy.resize(affordable);
+        }
+        for (const std::pair<float, int> &p: noisy) {
+            m_pixelStats(p.second%xRes, p.second/xRes).pending = batch;
+        }
+        pending = long(noisy.size())*batch;
+    }
+    timer.stop();
+    
+    int maxSamples = 0;
+    for (int j=0; j<yRes; j++) {
+        for (int i=0; i<xRes; i++) {
+            const PixelStats &stats = m_pixelStats(i, j);
+            m_rgbaBuffer(i, j) = Math::Vec4f(stats.mean.x, stats.mean.y, stats.mean.z, 1.0);
+            maxSamples = std::max(maxSamples, stats.n);
+        }
+    }
+    std::cout << "Adaptive sampling took " << timer.elapsedSeconds() << "s: "
+              << double(used)/pixels << " samples per pixel on average, "
+              << maxSamples << " at most" << std::endl;
+    display();
+}
+
+void
+PhotonMapper::display()
+{
+#ifndef RAYTRACER_HEADLESS
     glBindTexture(GL_TEXTURE_2D, m_fbo.colorTextureID(0));
     glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_fbo.width(), m_fbo.height(), GL_RGBA, GL_FLOAT, &m_rgbaBuffer(0,0));
     glBindTexture(GL_TEXTURE_2D, 0);    //Render to Screen
 	m_fbo.blitFramebuffer(FBO_COLOR0);
-//    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-//    m_fbo.displayAlphaAsFullScreenTexture(FBO_COLOR0);
-
+#endif
 }
 
 Math::Vec3f
@@ -126,27 +542,33 @@ PhotonMapper::rayMarch(Ray &r, double tmin, double tmax,
 //                       const Math::Box<Math::Vec3d>& box,
                        bool gather) const
 {
-    // March light sources
-    double dx = scene.rayMarchScatter*scene.rand_gen->nextd();
-    if (tmin+dx > tmax)
+    Math::Vec3f surface = nearestShape->surfaceShader->shade(this, r.hit, photonMap, specularPhotonMap, scene, gather);
+    Math::Vec3f col = surface*exp(-scene.sigma_t*(tmax-tmin));
+    if (scene.volumeMap == NULL)
+    {
+        return col;
+    }
+    
+    // Beam radiance estimate: every volume photon contributes its power
+    // times the length of the ray inside its sphere, divided by the
+    // sphere volume, and attenuated back to the start of the segment.
+    // The results are consumed before anything else can march a ray on
+    // this thread, so one scratch vector per thread suffices.
+    if (t_beamPhotons == NULL)
     {
-        return nearestShape->surfaceShader->shade(this, r.hit, photonMap, specularPhotonMap, scene, gather);
-    }
-    Math::Vec3f col(0,0,0);
-    Math::Vec3f p = r.o + r.d*tmin;
-    HitInfo hit;
-    hit.O = p;
-    Ray lray;
-    lray.o = p;
-    lray.tMin = 1e-3;
-    for (PhotonSource *source: scene.photonSources)
+        t_beamPhotons = new std::vector<BeamPhoton>();
+    }
+    std::vector<BeamPhoton> &photons = *t_beamPhotons;
+    photons.clear();
+    scene.volumeMap->beamQuery(photons, r.o, r.d, tmin, tmax);
+    Math::Vec3d inscatter(0,0,0);
+    for (const BeamPhoton& b: photons)
     {
-        lray.d = source->position-p;
-        if (scene.intersect(lray))
-        {
-            continue;
-        }
-        col += source->computeIntensity(hit, scene)*dx*scene.sigma_s/(4.0*M_PI);
+        double radius = b.photon->radius;
+        double volume = 4.0/3.0*M_PI*radius*radius*radius;
+        double f = exp(-scene.sigma_t*(b.t-tmin))*b.chord/volume;
+        inscatter += b.photon->power*f;
     }
-    return col+exp(-scene.sigma_t*dx)*rayMarch(r, tmin+dx, tmax, photonMap, specularPhotonMap, scene, nearestShape, gather);
-}
\ No newline at end of file
+    inscatter *= scene.sigma_s/(4.0*M_PI);
+    return col+Math::Vec3f(inscatter.x, inscatter.y, inscatter.z);
+}
@@ -10,15 +10,49 @@
 #define __RaytracerV3__PhotonMapper__
 
 #include "Renderer.h"
+#ifndef RAYTRACER_HEADLESS
 #include "OGL/FBO.h"
+#endif
 #include "Util/Array2D.h"
+#include "TileScheduler.h"
+#include "Denoiser.h"
+#include "ImageIO.h"
+#include "Math/Mat44.h"
 
 class PhotonMapper: Renderer
 {
 protected:
     void setRes(int x, int y);
+#ifndef RAYTRACER_HEADLESS
     FrameBuffer m_fbo;
+#endif
     Util::Array2D<Math::Color4f> m_rgbaBuffer;
+    Denoiser m_denoiser;
+    ImageStream *m_stream;
+    
+    // number of samples averaged in m_rgbaBuffer by renderPass()
+    int m_passes;
+    
+    // Next level of renderPreview(), -1 when done, and the camera the
+    // coarser levels were traced with
+    int m_previewLevel;
+    Math::Mat44d m_previewCamera;
+    
+    // Running mean and variance (Welford) of the samples of a pixel
+    struct PixelStats
+    {
+        Math::Color3f mean;
+        Math::Color3f m2;       // sum of squared deviations from the mean
+        int n;
+        int pending;            // samples to take in the current round
+        
+        void add(const Math::Color3f &c);
+        // standard error of the mean relative to its luminance
+        float relativeError() const;
+    };
+    Util::Array2D<PixelStats> m_pixelStats;
+    
+    Math::Vec3f samplePixel(Scene &scene, double x, double y) const;
 
 public:
     PhotonMapper();
@@ -26,6 +60,57 @@ public:
     
     virtual void render(Scene &scene);
     
+    // Rows finished by a full frame render() are passed to stream while
+    // the other tiles still render. NULL disables streaming.
+    void setImageStream(ImageStream *stream) {m_stream = stream;}
+    
+    // Traces only the pixels of region (x1, y1 exclusive, row 0 at the
+    // bottom) and keeps the rest of the previous frame
+    void renderRegion(Scene &scene, const TileScheduler::Tile &region);
+    
+    // Shows m_rgbaBuffer in the window
+    void display();
+    
+    // Filters m_rgbaBuffer with the Denoiser, guided by the features of
+    // the primary hits of the current camera
+    void denoise(const Scene &scene);
+    
+    // Adds one jittered sample per pixel to the running mean in
+    // m_rgbaBuffer and displays it.
+    void renderPass(Scene &scene);
+    void resetAccumulation() {m_passes = 0;}
+    
+    // Coarse to fine rendering: every call traces and displays the next
+    // level, first every 8th pixel in x and y, then every 4th, every 2nd
+    // and finally the rest. Samples of the coarser levels are kept, the
+    // pixels in between show the sample to their lower left until they
+    // are traced. Returns true once the full resolution image is done.
+    // A camera change starts over at the coarsest level.
+    bool renderPreview(Scene &scene);
+    void resetPreview() {m_previewLevel = -1;}
+    
+    // Renders within budget seconds: traces as many photons as fit into
+    // Scene::timeBudgetPhotonShare of it (unless the maps exist), then
+    // adds passes while the slowest pass so far still fits before the
+    // deadline. At least minPasses passes are rendered. Returns the
+    // number of samples per pixel.
+    int renderTimed(Scene &scene, double budget, int minPasses);
+    
+    // Renders spp samples per pixel (the first at the pixel center) of
+    // one image region into m_rgbaBuffer, without displaying it. The
+    // photon maps of the scene must exist.
+    void renderTile(Scene &scene, const TileScheduler::Tile &tile, int spp);
+    
+    // Spends Scene::adaptiveSamplesPerPixel camera samples (each with its
+    // own final gather) where the per pixel error is largest.
+    void renderAdaptive(Scene &scene);
+    int passes() const {return m_passes;}
+    
+    // The last rendered image, row 0 is the bottom of the screen
+    const Util::Array2D<Math::Color4f>& image() const {return m_rgbaBuffer;}
+    // Continues from a previously rendered (partial) image
+    void setImage(const Util::Array2D<Math::Color4f> &image);
+    
     virtual Math::Vec3f recursiveRender(Ray &r,
                                         PhotonMap& photonMap,
                                         PhotonMap& specularPhotonMap,
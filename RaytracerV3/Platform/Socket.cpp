@@ -0,0 +1,204 @@
+//
+//  Socket.cpp
+//  RaytracerV3
+//
+
+#include "Socket.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <iostream>
+
+namespace
+{
+    // A peer that went away must not kill the process with SIGPIPE
+#ifdef MSG_NOSIGNAL
+    const int g_sendFlags = MSG_NOSIGNAL;
+#else
+    const int g_sendFlags = 0;
+#endif
+
+    void
+    setStreamOptions(int fd)
+    {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    }
+}
+
+namespace Platform
+{
+
+Socket::Socket():
+    m_fd(-1)
+{
+    
+}
+
+Socket::~Socket()
+{
+    close();
+}
+
+void
+Socket::close()
+{
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool
+Socket::listen(int port, int backlog)
+{
+    close();
+    m_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (m_fd < 0)
+    {
+        perror("Socket::listen");
+        return false;
+    }
+    int on = 1;
+    setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (::bind(m_fd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+        ::listen(m_fd, backlog) < 0)
+    {
+        perror("Socket::listen");
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool
+Socket::accept(Socket &client)
+{
+    client.close();
+    int fd;
+    do {
+        fd = ::accept(m_fd, NULL, NULL);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0)
+    {
+        perror("Socket::accept");
+        return false;
+    }
+    setStreamOptions(fd);
+    client.m_fd = fd;
+    return true;
+}
+
+bool
+Socket::connect(const std::string &host, int port)
+{
+    close();
+    addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(host.c_str(), service, &hints, &result) != 0)
+    {
+        std::cerr << "Socket::connect: unknown host " << host << std::endl;
+        return false;
+    }
+    
+    for (addrinfo *a = result; a != NULL; a = a->ai_next)
+    {
+        m_fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (m_fd < 0)
+            continue;
+        if (::connect(m_fd, a->ai_addr, a->ai_addrlen) == 0)
+            break;
+        close();
+    }
+    freeaddrinfo(result);
+    
+    if (m_fd < 0)
+    {
+        std::cerr << "Socket::connect: could not connect to " << host << ":" << port << std::endl;
+        return false;
+    }
+    setStreamOptions(m_fd);
+    return true;
+}
+
+bool
+Socket::sendAll(const void *data, size_t size)
+{
+    const char *p = (const char*)data;
+    while (size > 0)
+    {
+        ssize_t n = ::send(m_fd, p, size, g_sendFlags);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool
+Socket::recvAll(void *data, size_t size)
+{
+    char *p = (char*)data;
+    while (size > 0)
+    {
+        ssize_t n = ::recv(m_fd, p, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool
+Socket::sendString(const std::string &s)
+{
+    return sendInt(int(s.size())) && sendAll(s.data(), s.size());
+}
+
+bool
+Socket::recvString(std::string &s)
+{
+    int size;
+    if (!recvInt(size) || size < 0)
+        return false;
+    s.resize(size);
+    return size == 0 || recvAll(&s[0], size);
+}
+
+int
+Socket::port() const
+{
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(m_fd, (sockaddr*)&addr, &len) < 0)
+        return -1;
+    return ntohs(addr.sin_port);
+}
+
+} // namespace Platform
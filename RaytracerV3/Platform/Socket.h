@@ -0,0 +1,52 @@
+//
+//  Socket.h
+//  RaytracerV3
+//
+
+#ifndef __RaytracerV3__Socket__
+#define __RaytracerV3__Socket__
+
+#include <string>
+#include <stddef.h>
+
+namespace Platform
+{
+
+//! Blocking TCP stream socket (POSIX).
+class Socket
+{
+public:
+    Socket();
+    ~Socket();
+    
+    //! Listens on all interfaces, port 0 picks a free port (see port()).
+    bool listen(int port, int backlog = 16);
+    //! Waits for a connection on a listening socket.
+    bool accept(Socket &client);
+    bool connect(const std::string &host, int port);
+    void close();
+    
+    //! Send / receive exactly size bytes, false if the peer is gone.
+    bool sendAll(const void *data, size_t size);
+    bool recvAll(void *data, size_t size);
+    
+    bool sendInt(int value) {return sendAll(&value, sizeof(int));}
+    bool recvInt(int &value) {return recvAll(&value, sizeof(int));}
+    bool sendString(const std::string &s);
+    bool recvString(std::string &s);
+    
+    int fd() const {return m_fd;}
+    bool valid() const {return m_fd >= 0;}
+    //! Local port the socket is bound to.
+    int port() const;
+    
+private:
+    Socket(const Socket&);
+    Socket& operator=(const Socket&);
+    
+    int m_fd;
+};
+
+} // namespace Platform
+
+#endif /* defined(__RaytracerV3__Socket__) */
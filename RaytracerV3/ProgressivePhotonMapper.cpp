@@ -0,0 +1,214 @@
+//
+//  ProgressivePhotonMapper.cpp
+//  RaytracerV3
+//
+//  Stochastic progressive photon mapping (Hachisuka and Jensen 2009).
+//
+
+#include "ProgressivePhotonMapper.h"
+#include <OpenGL/OpenGL.h>
+#include "PhotonSource.h"
+#include "PhotonMap.h"
+#include "Shape.h"
+#include "TileScheduler.h"
+#include "Platform/Stopwatch.h"
+#include <algorithm>
+
+// Maximum number of specular bounces of a camera path.
+const int g_maxSpecularDepth = 16;
+
+ProgressivePhotonMapper::ProgressivePhotonMapper():
+    m_fbo(FrameBuffer(GL_TEXTURE_2D, 512, 512, -1, GL_RGBA32F_ARB, 1, 1, 0, "ProgressivePhotonMapper FBO")),
+    m_pass(0)
+{
+    m_fbo.checkFramebufferStatus(1);
+}
+
+ProgressivePhotonMapper::~ProgressivePhotonMapper()
+{
+
+}
+
+void
+ProgressivePhotonMapper::setRes(int x, int y)
+{
+	m_rgbaBuffer.resizeErase(x, y);
+	m_hitPoints.resizeErase(x, y);
+	m_fbo.resizeExistingFBO(x, y);
+
+	// clear the buffers
+	m_rgbaBuffer = Math::Vec4f(0.0f);
+}
+
+void
+ProgressivePhotonMapper::reset(const Scene &scene)
+{
+    int xRes = scene.camera.xRes();
+    int yRes = scene.camera.yRes();
+    setRes(xRes, yRes);
+
+    HitPoint hp;
+    hp.valid = false;
+    hp.r2 = scene.sppmInitialRadius*scene.sppmInitialRadius;
+    hp.n = 0.0;
+    hp.tau = Math::Color3f(0.0f);
+    m_hitPoints.reset(hp);
+
+    m_cameraToWorld = scene.camera.cameraToWorld();
+    m_pass = 0;
+}
+
+void
+ProgressivePhotonMapper::traceHitPoint(HitPoint &hp, Ray &r, const Scene &scene) const
+{
+    Math::Color3f weight(1.0f);
+    hp.valid = false;
+    for (int depth = 0; depth < g_maxSpecularDepth; depth++)
+    {
+        Shape *s_hit = scene.intersect(r);
+        if (s_hit == NULL || s_hit->surfaceShader == NULL || s_hit->areaLight())
+        {
+            return;
+        }
+        s_hit->fillHitInfo(r);
+
+        const SurfaceShader *shader = r.hit.surfaceShader;
+        if (shader->diffuse())
+        {
+            hp.P = r.hit.P;
+            hp.N = r.hit.N;
+            hp.weight = weight*shader->albedo();
+            hp.valid = true;
+            return;
+        }
+
+        HitInfo hit = r.hit;
+        if (!shader->sampleSpecular(hit, r, weight, scene))
+        {
+            return;
+        }
+    }
+}
+
+void
+ProgressivePhotonMapper::emitPhotons(Scene &scene, std::vector<EmittedPhoton> &emittedPhotons) const
+{
+    // distribute the photons of this pass according to the photon
+    // budget of each light
+    int total = 0;
+    for (PhotonSource *source: scene.photonSources)
+    {
+        total += source->photons;
+    }
+    if (total <= 0)
+    {
+        return;
+    }
+
+    scene.seedStream(Scene::PHOTON_STREAM, m_pass);
+    for (PhotonSource *source: scene.photonSources)
+    {
+        int count = int(double(scene.sppmPhotonsPerPass)*source->photons/total);
+        if (count > 0)
+        {
+            source->emitPhotons(emittedPhotons, scene, count);
+        }
+    }
+}
+
+void
+ProgressivePhotonMapper::render(Scene &scene)
+{
+    int xRes = scene.camera.xRes();
+    int yRes = scene.camera.yRes();
+
+    // Any change of the view invalidates the accumulated statistics
+    if (m_pass == 0 ||
+        m_rgbaBuffer.sizeX() != xRes || m_rgbaBuffer.sizeY() != yRes ||
+        m_cameraToWorld != scene.camera.cameraToWorld())
+    {
+        reset(scene);
+    }
+
+    // 1. Trace the camera paths of this pass to their first diffuse surface
+    TileScheduler hitPointScheduler(xRes, yRes, scene.tileSize, scene.renderThreads);
+    hitPointScheduler.run([&](const TileScheduler::Tile &tile) {
+        for (int j=tile.y0; j<tile.y1; j++) {
+            for (int i=tile.x0; i<tile.x1; i++) {
+                scene.seedPixel(i, j, m_pass);
+                Math::Vec2d offset = scene.pixelJitter(i, j, m_pass);
+                Ray r = Ray();
+                scene.camera.generateRay(r, i+offset.x, j+offset.y);
+                traceHitPoint(m_hitPoints(i, j), r, scene);
+            }
+        }
+    });
+
+    // 2. Trace a bounded set of photons; the map is discarded after the pass.
+    // Every bounce stores at most one photon per map, as in Scene.
+    std::vector<EmittedPhoton> emittedPhotons;
+    emitPhotons(scene, emittedPhotons);
+    const int capacity = int(std::min(long(emittedPhotons.size())*std::max(scene.maxPhotonBounces, 1),
+                                      long(1024*1024*1024)));
+    PhotonMap photonMap(capacity);
+    PhotonMap specularPhotonMap(capacity);
+    photonMap.set_index(scene.photonMapIndex, scene.sppmInitialRadius);
+    for (size_t i=0; i<emittedPhotons.size(); i++)
+    {
+        scene.photonScattering(emittedPhotons[i], photonMap, specularPhotonMap);
+    }
+    if (photonMap.dropped() > 0 || specularPhotonMap.dropped() > 0)
+    {
+        std::cerr << "SPPM pass " << m_pass+1 << ": photon maps full, dropped "
+                  << photonMap.dropped() << " and " << specularPhotonMap.dropped()
+                  << " photons" << std::endl;
+    }
+    Platform::Stopwatch indexTimer;
+    indexTimer.start();
+    photonMap.balance();
+    indexTimer.stop();
+    m_pass++;
+
+    // 3. Progressive radiance estimate at every hit point
+    Platform::Stopwatch gatherTimer;
+    gatherTimer.start();
+    const double alpha = scene.sppmAlpha;
+    TileScheduler gatherScheduler(xRes, yRes, scene.tileSize, scene.renderThreads);
+    gatherScheduler.run([&](const TileScheduler::Tile &tile) {
+        for (int j=tile.y0; j<tile.y1; j++) {
+            for (int i=tile.x0; i<tile.x1; i++) {
+                HitPoint &hp = m_hitPoints(i, j);
+                if (hp.valid)
+                {
+                    float pos[3] = {float(hp.P.x), float(hp.P.y), float(hp.P.z)};
+                    float normal[3] = {float(hp.N.x), float(hp.N.y), float(hp.N.z)};
+                    float flux[3];
+                    int M = photonMap.fixed_radius_estimate(flux, pos, normal, sqrt(hp.r2));
+                    if (M > 0)
+                    {
+                        double ratio = (hp.n+alpha*M)/(hp.n+M);
+                        Math::Color3f phi(flux[0], flux[1], flux[2]);
+                        hp.n += alpha*M;
+                        hp.r2 *= ratio;
+                        hp.tau = (hp.tau + hp.weight*phi)*ratio;
+                    }
+                }
+
+                Math::Color3f col = hp.tau/(M_PI*hp.r2*m_pass);
+                m_rgbaBuffer(i, j) = Math::Vec4f(col.x, col.y, col.z, 1.0);
+            }
+        }
+    });
+
+    gatherTimer.stop();
+
+	//Copy the current estimate to the texture
+    glBindTexture(GL_TEXTURE_2D, m_fbo.colorTextureID(0));
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_fbo.width(), m_fbo.height(), GL_RGBA, GL_FLOAT, &m_rgbaBuffer(0,0));
+    glBindTexture(GL_TEXTURE_2D, 0);    //Render to Screen
+	m_fbo.blitFramebuffer(FBO_COLOR0);
+
+    std::cout << "SPPM pass " << m_pass << "/" << scene.sppmPasses
+              << " (index " << indexTimer.elapsedSeconds() << "s, gather "
+              << gatherTimer.elapsedSeconds() << "s)" << std::endl;
+}
@@ -0,0 +1,57 @@
+//
+//  ProgressivePhotonMapper.h
+//  RaytracerV3
+//
+//  Stochastic progressive photon mapping (Hachisuka and Jensen 2009).
+//  Every call to render() traces one pass: new camera hit points, a
+//  bounded batch of photons, and a radius reduction per pixel. Memory
+//  use only depends on the resolution and Scene::sppmPhotonsPerPass.
+//
+
+#ifndef __RaytracerV3__ProgressivePhotonMapper__
+#define __RaytracerV3__ProgressivePhotonMapper__
+
+#include "Renderer.h"
+#include "OGL/FBO.h"
+#include "Util/Array2D.h"
+#include "Math/Mat44.h"
+
+class ProgressivePhotonMapper: public Renderer
+{
+protected:
+    struct HitPoint
+    {
+        Math::Vec3d P;              //!< Position of the diffuse hit
+        Math::Vec3d N;              //!< Shading normal at P
+        Math::Color3f weight;       //!< Path throughput times albedo
+        bool valid;                 //!< False if the path left the scene
+
+        double r2;                  //!< Squared gather radius
+        double n;                   //!< Accumulated photon count
+        Math::Color3f tau;          //!< Accumulated (radius corrected) flux
+    };
+
+    void setRes(int x, int y);
+    void reset(const Scene &scene);
+    void traceHitPoint(HitPoint &hp, Ray &r, const Scene &scene) const;
+    void emitPhotons(Scene &scene, std::vector<EmittedPhoton> &emittedPhotons) const;
+
+    FrameBuffer m_fbo;
+    Util::Array2D<Math::Color4f> m_rgbaBuffer;
+    Util::Array2D<HitPoint> m_hitPoints;
+
+    int m_pass;
+    Math::Mat44d m_cameraToWorld;
+
+public:
+    ProgressivePhotonMapper();
+    ~ProgressivePhotonMapper();
+
+    //! Traces one SPPM pass and displays the current estimate.
+    virtual void render(Scene &scene);
+
+    int passes() const {return m_pass;}
+    bool done(const Scene &scene) const {return m_pass >= scene.sppmPasses;}
+};
+
+#endif /* defined(__RaytracerV3__ProgressivePhotonMapper__) */
@@ -0,0 +1,119 @@
+//
+//  RenderCheckpoint.cpp
+//  RaytracerV3
+//
+
+#include "RenderCheckpoint.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    const char g_magic[4] = {'R','T','C','3'};
+}
+
+RenderCheckpoint::RenderCheckpoint():
+    width(0),
+    height(0),
+    spp(0),
+    gatherSamples(0),
+    tileSize(0),
+    seed(0),
+    sampler(0)
+{
+    
+}
+
+bool
+RenderCheckpoint::matches(const RenderCheckpoint &other) const
+{
+    return scene == other.scene &&
+           width == other.width && height == other.height &&
+           spp == other.spp && gatherSamples == other.gatherSamples &&
+           tileSize == other.tileSize && sampler == other.sampler;
+}
+
+bool
+RenderCheckpoint::save(const std::string &filename,
+                       const Util::Array2D<Math::Color4f> &image) const
+{
+    const std::string tmp = filename+".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (file == NULL)
+    {
+        std::cerr << "RenderCheckpoint: could not open " << tmp << std::endl;
+        return false;
+    }
+    
+    int header[8] = {int(scene.size()), width, height, spp, gatherSamples,
+                     tileSize, int(tileDone.size()), sampler};
+    const size_t pixels = size_t(image.sizeX())*image.sizeY();
+    bool ok = fwrite(g_magic, 1, 4, file) == 4 &&
+              fwrite(header, sizeof(int), 8, file) == 8 &&
+              fwrite(scene.data(), 1, scene.size(), file) == scene.size() &&
+              (tileDone.empty() || fwrite(&tileDone[0], 1, tileDone.size(), file) == tileDone.size()) &&
+              fwrite(&seed, sizeof(uint64_t), 1, file) == 1 &&
+              size_t(width)*height == pixels;
+    for (int j=0; ok && j<height; j++)
+    {
+        for (int i=0; ok && i<width; i++)
+        {
+            ok = fwrite(&image(i, j), sizeof(Math::Color4f), 1, file) == 1;
+        }
+    }
+    ok = (fclose(file) == 0) && ok;
+    
+    if (!ok || rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        std::cerr << "RenderCheckpoint: could not write " << filename << std::endl;
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool
+RenderCheckpoint::load(const std::string &filename)
+{
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    
+    char magic[4];
+    int header[8];
+    bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, g_magic, 4) == 0 &&
+              fread(header, sizeof(int), 8, file) == 8 &&
+              header[0] >= 0 && header[1] > 0 && header[2] > 0 && header[6] >= 0;
+    if (ok)
+    {
+        scene.resize(header[0]);
+        width = header[1];
+        height = header[2];
+        spp = header[3];
+        gatherSamples = header[4];
+        tileSize = header[5];
+        tileDone.resize(header[6]);
+        sampler = header[7];
+        image.resizeErase(width, height);
+        ok = (scene.empty() || fread(&scene[0], 1, scene.size(), file) == scene.size()) &&
+             (tileDone.empty() || fread(&tileDone[0], 1, tileDone.size(), file) == tileDone.size()) &&
+             fread(&seed, sizeof(uint64_t), 1, file) == 1;
+    }
+    for (int j=0; ok && j<height; j++)
+    {
+        for (int i=0; ok && i<width; i++)
+        {
+            ok = fread(&image(i, j), sizeof(Math::Color4f), 1, file) == 1;
+        }
+    }
+    fclose(file);
+    
+    if (!ok)
+    {
+        std::cerr << "RenderCheckpoint: " << filename << " is not a valid checkpoint" << std::endl;
+    }
+    return ok;
+}
@@ -0,0 +1,47 @@
+//
+//  RenderCheckpoint.h
+//  RaytracerV3
+//
+//  State of a tiled batch render: which tiles are finished, their pixels
+//  and the random number generator. The photon maps are written once
+//  next to it (filename.pmap) with Scene::savePhotonMaps.
+//
+
+#ifndef __RaytracerV3__RenderCheckpoint__
+#define __RaytracerV3__RenderCheckpoint__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "Math/Color.h"
+#include "Util/Array2D.h"
+
+struct RenderCheckpoint
+{
+    // the render this checkpoint belongs to
+    std::string scene;
+    int width;
+    int height;
+    int spp;
+    int gatherSamples;
+    int tileSize;
+    
+    std::vector<char> tileDone;
+    uint64_t seed;                          // Scene::seed of the render
+    int sampler;                            // Scene::sampler of the render
+    Util::Array2D<Math::Color4f> image;     // filled by load()
+    
+    RenderCheckpoint();
+    
+    // A matching render can be continued from this checkpoint
+    bool matches(const RenderCheckpoint &other) const;
+    
+    // Writes to filename.tmp first, so a kill never leaves a broken file
+    bool save(const std::string &filename,
+              const Util::Array2D<Math::Color4f> &image) const;
+    bool load(const std::string &filename);
+    
+    static std::string photonFile(const std::string &filename) {return filename+".pmap";}
+};
+
+#endif /* defined(__RaytracerV3__RenderCheckpoint__) */
@@ -17,7 +17,9 @@
 #include "DiffuseSquareAreaLight.h"
 #include "SpecularDielectricShader.h"
 #include "SpecularMirrorShader.h"
+#ifndef RAYTRACER_HEADLESS
 #include <GL/glfw.h>
+#endif
 
 
 using namespace Math;
@@ -35,9 +37,30 @@ SceneLoader::loadScene()
 //    loadCave();
 }
 
+bool
+SceneLoader::loadScene(const std::string &name)
+{
+    if (name == "cornell_fog")
+        loadCornellBoxFog();
+    else if (name == "cave")
+        loadCave();
+    else if (name == "cornell")
+        loadCornellBox();
+    else if (name == "spheres")
+        loadSpheres();
+    else
+    {
+        std::cerr << "SceneLoader: unknown scene '" << name
+                  << "' (cornell_fog, cave, cornell, spheres)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
 bool
 SceneLoader::handleSceneLoading()
 {
+#ifndef RAYTRACER_HEADLESS
     if (glfwGetKey('1')) {
         loadCornellBoxFog();
         return true;
@@ -58,6 +81,7 @@ SceneLoader::handleSceneLoading()
         loadSpheres();
         return true;
     }
+#endif
     return false;
 }
 
@@ -125,6 +149,8 @@ SceneLoader::loadCave()
     scene._monteCarloSamples = 64;
     scene.fog.push_back(Box<Vec3d>(Vec3d(-100.0, -100.0, -100.0), Vec3d(100,100,-7)));
     scene.rayMarchScatter = 5.0;
+    scene.volumePhotonRadius = 2.0;
+    scene.sppmInitialRadius = 0.5;
 }
 
 void
@@ -159,6 +185,7 @@ SceneLoader::loadCornellBoxFog()
     // FOG
     scene.fog.push_back(Box<Vec3d>(Vec3d(-1.0, -1.0, -1.0), Vec3d(1,1,1)));
     scene.rayMarchScatter = 0.2;
+    scene.volumePhotonRadius = 0.1;
     IsotropicPointLight *light = new IsotropicPointLight(
                                                          Vec3d(0,0,1.001),
                                                        lightColor,
@@ -168,6 +195,9 @@ SceneLoader::loadCornellBoxFog()
         
     scene.maxPhotonMapSearchDist = 0.1;
     scene.numPhotonMapPhotons = 500;
+    scene.sppmInitialRadius = 0.05;
+    scene.useProjectionMaps = true;
+    scene.causticPhotons = 1024*100;
 
     double sphere_radius = 0.3;
     double pos = 1.0-1.8*sphere_radius;
@@ -223,6 +253,9 @@ SceneLoader::loadCornellBox()
     
     scene.maxPhotonMapSearchDist = 0.1;
     scene.numPhotonMapPhotons = 500;
+    scene.sppmInitialRadius = 0.05;
+    scene.useProjectionMaps = true;
+    scene.causticPhotons = 1024*100;
     
     double sphere_radius = 0.3;
     double pos = 1.0-1.8*sphere_radius;
@@ -10,6 +10,7 @@
 #define __RaytracerV3__SceneLoader__
 
 #include "Scene.h"
+#include <string>
 class SceneLoader
 {
     Scene &scene;
@@ -18,6 +19,8 @@ public:
     void reset();
 
     void loadScene();
+    // Loads a scene by name (cornell_fog, cave, cornell, spheres)
+    bool loadScene(const std::string &name);
     void loadSpheres();
     void loadCave();
     bool handleSceneLoading();
@@ -0,0 +1,93 @@
+//
+//  LayoutBench.cpp
+//  RaytracerV3
+//
+
+// Times two framebuffer write patterns with both Array2D layouts: square
+// tiles from the TileScheduler, as the renderers write them, and one
+// parallel loop per column.
+//
+//     layout-bench [width height [tileSize [threads]]]
+
+#include "Util/Array2D.h"
+#include "Math/Color.h"
+#include "Core/TileScheduler.h"
+#include "Platform/Stopwatch.h"
+#include <cstdlib>
+#include <iostream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+int
+main(int argc, char *argv[])
+{
+    const int width = argc > 2 ? atoi(argv[1]) : 1024;
+    const int height = argc > 2 ? atoi(argv[2]) : 768;
+    const int tileSize = argc > 3 ? atoi(argv[3]) : 32;
+    const int threads = argc > 4 ? atoi(argv[4]) : 0;
+    if (width <= 0 || height <= 0 || tileSize <= 0)
+    {
+        std::cerr << "usage: " << argv[0] << " [width height [tileSize [threads]]]" << std::endl;
+        return 1;
+    }
+    
+    const int repetitions = 20;
+    const char *names[2] = {"linear", "tiled"};
+    const Util::Array2DLayout layouts[2] = {Util::ARRAY2D_LINEAR, Util::ARRAY2D_TILED};
+    const double pixels = double(width)*height*repetitions;
+#ifdef _OPENMP
+    if (threads > 0)
+    {
+        omp_set_num_threads(threads);
+    }
+#endif
+    
+    std::cout << "Framebuffer writes, " << width << "x" << height
+              << ", tile size " << tileSize << ", ns per pixel:" << std::endl;
+    for (int l=0; l<2; l++)
+    {
+        Util::Array2D<Math::Color4f> image;
+        image.setLayout(layouts[l]);
+        image.resizeErase(width, height);
+        image.reset(Math::Color4f(0.0f));
+        
+        Platform::Stopwatch tiles;
+        tiles.start();
+        for (int r=0; r<repetitions; r++)
+        {
+            TileScheduler scheduler(width, height, tileSize, threads);
+            scheduler.run([&](const TileScheduler::Tile &tile) {
+                for (int j=tile.y0; j<tile.y1; j++)
+                    for (int i=tile.x0; i<tile.x1; i++)
+                        image(i, j) += Math::Color4f(float(i), float(j), float(r), 1.0f);
+            });
+        }
+        tiles.stop();
+        
+        Platform::Stopwatch columns;
+        columns.start();
+        for (int r=0; r<repetitions; r++)
+        {
+            for (int i=0; i<width; i++)
+            {
+                #pragma omp parallel for
+                for (int j=0; j<height; j++)
+                    image(i, j) += Math::Color4f(float(i), float(j), float(r), 1.0f);
+            }
+        }
+        columns.stop();
+        
+        // keep the writes from being optimized away
+        double checksum = 0.0;
+        for (int j=0; j<height; j++)
+            for (int i=0; i<width; i++)
+                checksum += image(i, j).w;
+        
+        std::cout << "  " << names[l] << ": tiles "
+                  << 1e9*tiles.elapsedSeconds()/pixels << ", columns "
+                  << 1e9*columns.elapsedSeconds()/pixels
+                  << " (checksum " << checksum << ")" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+//
+//  WarpBench.cpp
+//  RaytracerV3
+//
+
+// Times the batched Warp mappings against the per sample ones on cache
+// sized batches (a final gather set is much smaller still). Accuracy is
+// checked by WarpTest.cpp.
+
+#include "Math/Warp.h"
+#include "Math/PCG.h"
+#include "Platform/Stopwatch.h"
+#include <iostream>
+#include <vector>
+
+int
+main(int, char**)
+{
+    const int batchSize = 1024;
+    const int batches = 1024;
+    const int count = batchSize*batches;
+    Math::PCG32 rng;
+    rng.seed(1, 1);
+    std::vector<Math::Vec2d> samples(count);
+    for (int i=0; i<count; i++)
+    {
+        samples[i] = Math::Vec2d(rng.nextd(), rng.nextd());
+    }
+    
+    std::vector<Math::Vec3d> dirs(2*batchSize);
+    Platform::Stopwatch timer;
+    for (int f=0; f<2; f++)
+    {
+        const char *name = f == 0 ? "cosineHemisphere" : "uniformSphere";
+        timer.restart();
+        for (int b=0; b<batches; b++)
+        {
+            const Math::Vec2d *batch = &samples[b*batchSize];
+            if (f == 0)
+                Math::Warp::cosineHemisphereBatch(&dirs[0], batch, batchSize);
+            else
+                Math::Warp::uniformSphereBatch(&dirs[0], batch, batchSize);
+        }
+        timer.stop();
+        const double batched = timer.elapsedSeconds();
+        
+        timer.restart();
+        for (int b=0; b<batches; b++)
+        {
+            const Math::Vec2d *batch = &samples[b*batchSize];
+            for (int i=0; i<batchSize; i++)
+            {
+                if (f == 0)
+                    Math::Warp::cosineHemisphere(&dirs[batchSize+i], batch[i].x, batch[i].y);
+                else
+                    Math::Warp::uniformSphere(&dirs[batchSize+i], batch[i].x, batch[i].y);
+            }
+        }
+        timer.stop();
+        
+        // keep the mappings from being optimized away
+        const double checksum = dirs[0].x+dirs[batchSize].x;
+        std::cout << name << ": batched " << 1e9*batched/count
+                  << " ns, per sample " << 1e9*timer.elapsedSeconds()/count
+                  << " ns (checksum " << checksum << ")" << std::endl;
+    }
+#ifdef __AVX__
+    std::cout << "Batched warps use AVX" << std::endl;
+#else
+    std::cout << "Batched warps use scalar code (no AVX)" << std::endl;
+#endif
+    return 0;
+}
@@ -0,0 +1,99 @@
+//
+//  WarpTest.cpp
+//  RaytracerV3
+//
+
+// Checks that the batched Warp mappings stay within WARP_BATCH_MAX_ERROR
+// of the exact mappings. The counts are no multiples of the AVX width, so
+// the scalar tail is checked as well, and the short counts run the tail
+// only. Timings are in WarpBench.cpp.
+
+#include "Math/Warp.h"
+#include "Math/PCG.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    Math::Vec3d
+    exactCosineHemisphere(const Math::Vec2d &sample)
+    {
+        const double s = sample.x, t = sample.y;
+        return Math::Vec3d(sqrt(s)*cos(2.0*M_PI*t), sqrt(s)*sin(2.0*M_PI*t), sqrt(1.0-s));
+    }
+    
+    Math::Vec3d
+    exactUniformSphere(const Math::Vec2d &sample)
+    {
+        const double h = 2.0*sample.y-1.0;
+        const double a = sqrt(std::max(0.0, 1.0-h*h));
+        return Math::Vec3d(a*sin(2.0*M_PI*sample.x), a*cos(2.0*M_PI*sample.x), h);
+    }
+    
+    // Largest absolute error per component of the first count samples
+    double
+    maxError(bool sphere, const std::vector<Math::Vec2d> &samples, int count)
+    {
+        std::vector<Math::Vec3d> dirs(count);
+        if (sphere)
+            Math::Warp::uniformSphereBatch(&dirs[0], &samples[0], count);
+        else
+            Math::Warp::cosineHemisphereBatch(&dirs[0], &samples[0], count);
+        
+        double error = 0.0;
+        for (int i=0; i<count; i++)
+        {
+            const Math::Vec3d exact = sphere ? exactUniformSphere(samples[i])
+                                             : exactCosineHemisphere(samples[i]);
+            for (int k=0; k<3; k++)
+            {
+                error = std::max(error, fabs(dirs[i][k]-exact[k]));
+            }
+        }
+        return error;
+    }
+}
+
+int
+main(int, char**)
+{
+    const int count = (1 << 20)+3;
+    const int counts[] = {count, 1, 2, 3, 5, 7};
+    
+    Math::PCG32 rng;
+    rng.seed(1, 1);
+    std::vector<Math::Vec2d> samples(count);
+    for (int i=0; i<count; i++)
+    {
+        samples[i] = Math::Vec2d(rng.nextd(), rng.nextd());
+    }
+    // both ends of the unit square, in the vector part and in the tail
+    samples[0] = Math::Vec2d(0.0, 0.0);
+    samples[1] = Math::Vec2d(1.0-1e-16, 1.0-1e-16);
+    samples[count-1] = Math::Vec2d(1.0-1e-16, 0.0);
+    samples[count-2] = Math::Vec2d(0.0, 1.0-1e-16);
+    
+    bool ok = true;
+    for (int f=0; f<2; f++)
+    {
+        const char *name = f == 0 ? "cosineHemisphereBatch" : "uniformSphereBatch";
+        for (size_t c=0; c<sizeof(counts)/sizeof(counts[0]); c++)
+        {
+            const double error = maxError(f == 1, samples, counts[c]);
+            const bool pass = error < Math::WARP_BATCH_MAX_ERROR;
+            std::cout << name << "(" << counts[c] << "): max error " << error
+                      << (pass ? "" : " FAILED") << std::endl;
+            ok = ok && pass;
+        }
+    }
+    
+    if (!ok)
+    {
+        std::cerr << "Batched warps exceed the error bound "
+                  << Math::WARP_BATCH_MAX_ERROR << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -5,14 +5,34 @@
 #ifndef UTIL_ARRAY2D_H
 #define UTIL_ARRAY2D_H
 
+#include <vector>
+
 namespace Util
 {
 
+//! Storage order of the elements of an Array2D.
+/*!
+    ARRAY2D_LINEAR stores the rows one after the other. ARRAY2D_TILED
+    stores blocks of TILE x TILE elements contiguously (the blocks and the
+    elements inside a block are in row order), so that a thread writing a
+    rectangular image tile owns whole cache lines instead of sharing the
+    ends of every row with its neighbours. Use linear() to get a row
+    ordered copy, e.g. for an OpenGL upload.
+*/
+enum Array2DLayout
+{
+    ARRAY2D_LINEAR,
+    ARRAY2D_TILED
+};
+
 //! Generic, resizable, 2D array class.
 template <typename T>
 class Array2D
 {
 public:
+    static const int TILE_SHIFT = 3;
+    static const int TILE = 1 << TILE_SHIFT;
+    
     //@{ \name Constructors and destructors
     Array2D();                     // empty array, 0 by 0 elements
     Array2D(int sizeX, int sizeY); // sizeX by sizeY elements
@@ -22,10 +42,20 @@ public:
     //@{ \name Element access
     T &         operator()(int x, int y);
     const T &   operator()(int x, int y) const;
-    T &         operator[](int i);
+    T &         operator[](int i);     // i-th element in storage order
     const T &   operator[](int i) const;
     //@}
     
+    //@{ \name Storage layout
+    Array2DLayout layout() const { return m_layout; }
+    void setLayout(Array2DLayout layout);   // erases the contents
+    int storageSize() const { return m_storageSize; }
+    
+    // Row ordered elements: the data itself for linear arrays, otherwise
+    // a copy in scratch
+    const T* linear(std::vector<T> &scratch) const;
+    //@}
+    
     //@{ \name Dimension sizes
     int width()  const { return m_sizeX; }
     int height() const { return m_sizeY; }
@@ -44,6 +74,12 @@ public:
     T * m_data;
     int m_sizeX;
     int m_sizeY;
+    Array2DLayout m_layout;
+    int m_tilesX;           // tiles per block row (ARRAY2D_TILED)
+    int m_storageSize;      // allocated elements, padded to whole tiles
+    
+    int index(int x, int y) const;
+    void allocate(int sizeX, int sizeY);
 
 private:
     Array2D (const Array2D &);              // Copying and assignment
@@ -53,7 +89,8 @@ private:
 template <typename T>
 inline
 Array2D<T>::Array2D():
-    m_data(0), m_sizeX(0), m_sizeY(0)
+    m_data(0), m_sizeX(0), m_sizeY(0),
+    m_layout(ARRAY2D_LINEAR), m_tilesX(0), m_storageSize(0)
 {
     // empty
 }
@@ -62,9 +99,10 @@ Array2D<T>::Array2D():
 template <typename T>
 inline
 Array2D<T>::Array2D(int sizeX, int sizeY):
-    m_data(new T[sizeX * sizeY]), m_sizeX(sizeX), m_sizeY(sizeY)
+    m_data(0), m_sizeX(0), m_sizeY(0),
+    m_layout(ARRAY2D_LINEAR), m_tilesX(0), m_storageSize(0)
 {
-    // empty
+    allocate(sizeX, sizeY);
 }
 
 
@@ -76,11 +114,38 @@ Array2D<T>::~Array2D ()
 }
 
 
+template <typename T>
+inline int
+Array2D<T>::index(int x, int y) const
+{
+    if (m_layout == ARRAY2D_LINEAR)
+        return y*m_sizeX + x;
+    const int tile = (y >> TILE_SHIFT)*m_tilesX + (x >> TILE_SHIFT);
+    return (tile << (2*TILE_SHIFT)) + ((y & (TILE-1)) << TILE_SHIFT) + (x & (TILE-1));
+}
+
+
+template <typename T>
+inline void
+Array2D<T>::allocate(int sizeX, int sizeY)
+{
+    delete [] m_data;
+    m_sizeX = sizeX;
+    m_sizeY = sizeY;
+    m_tilesX = (sizeX + TILE-1) >> TILE_SHIFT;
+    if (m_layout == ARRAY2D_LINEAR)
+        m_storageSize = sizeX*sizeY;
+    else
+        m_storageSize = (m_tilesX*((sizeY + TILE-1) >> TILE_SHIFT)) << (2*TILE_SHIFT);
+    m_data = new T[m_storageSize];
+}
+
+
 template <typename T>
 inline T &
 Array2D<T>::operator()(int x, int y)
 {
-    return m_data[y*m_sizeX + x];
+    return m_data[index(x, y)];
 }
 
 
@@ -88,7 +153,7 @@ template <typename T>
 inline const T &
 Array2D<T>::operator()(int x, int y) const
 {
-    return m_data[y*m_sizeX + x];
+    return m_data[index(x, y)];
 }
 
 
@@ -108,6 +173,32 @@ Array2D<T>::operator[](int i) const
 }
 
 
+template <typename T>
+inline void
+Array2D<T>::setLayout(Array2DLayout layout)
+{
+    if (layout == m_layout)
+        return;
+    m_layout = layout;
+    allocate(m_sizeX, m_sizeY);
+}
+
+
+template <typename T>
+inline const T*
+Array2D<T>::linear(std::vector<T> &scratch) const
+{
+    if (m_layout == ARRAY2D_LINEAR)
+        return m_data;
+    scratch.resize(m_sizeX*m_sizeY);
+    for (int y = 0; y < m_sizeY; y++)
+        for (int x = 0; x < m_sizeX; x++)
+            scratch[y*m_sizeX + x] = (*this)(x, y);
+    return scratch.empty() ? 0 : &scratch[0];
+}
+
+
+//! Takes ownership of data, a linear sizeX by sizeY array.
 template <typename T>
 inline T*
 Array2D<T>::setData(T * data, int sizeX, int sizeY)
@@ -116,6 +207,9 @@ Array2D<T>::setData(T * data, int sizeX, int sizeY)
     m_data = data;
     m_sizeX = sizeX;
     m_sizeY = sizeY;
+    m_layout = ARRAY2D_LINEAR;
+    m_tilesX = (sizeX + TILE-1) >> TILE_SHIFT;
+    m_storageSize = sizeX*sizeY;
     return oldData;
 }
 
@@ -127,10 +221,7 @@ Array2D<T>::resizeErase(int sizeX, int sizeY)
     if (sizeX == m_sizeX && sizeY == m_sizeY)
         return;
 
-    delete [] m_data;
-    m_data = new T[sizeX * sizeY];
-    m_sizeX = sizeX;
-    m_sizeY = sizeY;
+    allocate(sizeX, sizeY);
 }
 
 
@@ -138,8 +229,7 @@ template <typename T>
 inline void
 Array2D<T>::reset(const T& value)
 {
-    int size = m_sizeX*m_sizeY;
-    for (int i = 0; i < size; i++)
+    for (int i = 0; i < m_storageSize; i++)
         m_data[i] = value;
 }
 
@@ -14,6 +14,8 @@
 #include "Math/Core.h"
 #include "RenderGL.h"
 #include "PhotonMapper.h"
+#include "ProgressivePhotonMapper.h"
+#include <algorithm>
 
 using namespace Main;
 using namespace Math;
@@ -24,7 +26,11 @@ const double g_scaleFact = 0.0005f;
 const char * renderModeNames[] =
 {
 	"RENDER_GL",
-	"RENDER_RAYTRACE"
+	"RENDER_RAYTRACE",
+	"RENDER_SPPM",
+	"RENDER_PROGRESSIVE",
+	"RENDER_ADAPTIVE",
+	"RENDER_PREVIEW"
 };
 
 
@@ -34,7 +40,13 @@ Window::Window(uint width, uint height):
     scene(),
     sceneLoader(scene),
     mouseX(0),
-    mouseY(0)
+    mouseY(0),
+    progressiveRenderer(NULL),
+    photonMapper(NULL),
+    cropSelecting(false),
+    cropDragging(false),
+    hasCrop(false),
+    denoiseKey(false)
 {
     /* Initialize the library */
     if (!glfwInit())
@@ -59,6 +71,12 @@ Window::Window(uint width, uint height):
     openGLWireFrameMode = true;
 }
 
+Window::~Window()
+{
+    delete progressiveRenderer;
+    delete photonMapper;
+}
+
 int
 Window::run()
 {
@@ -77,7 +95,10 @@ Window::run()
         if (render) {
             glFinish();
             glfwSwapBuffers();
-            render = false;
+            // progressive rendering continues without waiting for events
+            render = (renderMode == RENDER_SPPM || renderMode == RENDER_PREVIEW ||
+                      (renderMode == RENDER_PROGRESSIVE &&
+                       photonMapper->passes() < scene.progressivePasses));
         } else {
             glfwWaitEvents();
         }
@@ -96,8 +117,24 @@ Window::mainLoop()
     {
         render = true;
         renderMode = RENDER_GL;
+        delete progressiveRenderer;
+        progressiveRenderer = NULL;
+        delete photonMapper;
+        photonMapper = NULL;
     }
-    if (render) {
+    if (render && cropDragging) {
+        // show the selection on top of the last image
+        if (photonMapper != NULL && renderMode != RENDER_GL)
+        {
+            photonMapper->display();
+        }
+        else
+        {
+            RenderGL renderer;
+            renderer.render(scene, openGLWireFrameMode);
+        }
+        drawCropSelection();
+    } else if (render) {
         switch (renderMode) {
             case RENDER_GL:
             {
@@ -106,9 +143,63 @@ Window::mainLoop()
                 break;
             }
             case RENDER_RAYTRACE:
+            {
+                // the renderer keeps the last frame to composite crops over
+                if (photonMapper == NULL)
+                {
+                    photonMapper = new PhotonMapper();
+                }
+                if (hasCrop)
+                {
+                    photonMapper->renderRegion(scene, crop);
+                }
+                else
+                {
+                    photonMapper->render(scene);
+                }
+                renderMode = RENDER_GL;
+                break;
+            }
+            case RENDER_PREVIEW:
+            {
+                // one resolution level per frame, so every level shows up
+                if (photonMapper == NULL)
+                {
+                    photonMapper = new PhotonMapper();
+                }
+                if (photonMapper->renderPreview(scene))
+                {
+                    renderMode = RENDER_GL;
+                }
+                break;
+            }
+            case RENDER_SPPM:
+            {
+                if (progressiveRenderer == NULL)
+                {
+                    progressiveRenderer = new ProgressivePhotonMapper();
+                }
+                progressiveRenderer->render(scene);
+                // keep refining until the pass budget is used up
+                if (progressiveRenderer->done(scene))
+                {
+                    renderMode = RENDER_GL;
+                }
+                break;
+            }
+            case RENDER_PROGRESSIVE:
+            {
+                if (photonMapper == NULL)
+                {
+                    photonMapper = new PhotonMapper();
+                }
+                photonMapper->renderPass(scene);
+                break;
+            }
+            case RENDER_ADAPTIVE:
             {
                 PhotonMapper renderer;
-                renderer.render(scene);
+                renderer.renderAdaptive(scene);
                 renderMode = RENDER_GL;
                 break;
             }
@@ -132,6 +223,15 @@ Window::updateWindowInformation()
     }
 }
 
+void
+Window::resetAccumulation()
+{
+    if (photonMapper != NULL)
+    {
+        photonMapper->resetAccumulation();
+    }
+}
+
 void
 Window::rotate(int dx, int dy)
 {
@@ -159,6 +259,7 @@ Window::rotate(int dx, int dy)
         c2w = Mat44d(A, B, C, c2w.D());
         
         scene.camera.setCameraToWorld(c2w);
+        resetAccumulation();
     }
     catch (const std::exception & e)
     {
@@ -186,6 +287,7 @@ Window::twist(int dx, int dy)
         c2w = Mat44d(A, B, c2w.C(), c2w.D());
         
         scene.camera.setCameraToWorld(c2w);
+        resetAccumulation();
     }
     catch (const std::exception & e)
     {
@@ -203,6 +305,7 @@ Window::pan(int dx, int dy, int dz)
         c2w.setD(c2w.D() - dx*g_scaleFact*c2w.A() + dy*g_scaleFact*c2w.B() - dz*g_scaleFact*c2w.C());
 		
         scene.camera.setCameraToWorld(c2w);
+        resetAccumulation();
         
     }
     catch (const std::exception & e)
@@ -212,9 +315,87 @@ Window::pan(int dx, int dy, int dz)
 }
 
 
+void
+Window::handle_cropSelection()
+{
+    int mx, my, w, h;
+    glfwGetMousePos(&mx, &my);
+    glfwGetWindowSize(&w, &h);
+    if (glfwGetMouseButton(GLFW_MOUSE_BUTTON_1))
+    {
+        if (!cropDragging)
+        {
+            cropDragging = true;
+            cropStartX = mx;
+            cropStartY = my;
+        }
+        render = true;
+        return;
+    }
+    if (!cropDragging)
+    {
+        return;
+    }
+    
+    // released: mouse rows count from the top, image rows from the bottom
+    cropDragging = false;
+    cropSelecting = false;
+    crop.x0 = std::max(std::min(cropStartX, mx), 0);
+    crop.x1 = std::min(std::max(cropStartX, mx)+1, w);
+    crop.y0 = std::max(h-1-std::max(cropStartY, my), 0);
+    crop.y1 = std::min(h-std::min(cropStartY, my), h);
+    hasCrop = crop.x1 > crop.x0 && crop.y1 > crop.y0;
+    if (hasCrop)
+    {
+        std::cout << "Crop window [" << crop.x0 << ", " << crop.x1 << ") x ["
+                  << crop.y0 << ", " << crop.y1 << ")" << std::endl;
+        renderMode = RENDER_RAYTRACE;
+    }
+    render = true;
+}
+
+void
+Window::drawCropSelection() const
+{
+    int mx, my, w, h;
+    glfwGetMousePos(&mx, &my);
+    glfwGetWindowSize(&w, &h);
+    
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_LIGHTING);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, w, h, 0, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    
+    glColor3f(1.0f, 1.0f, 0.0f);
+    glBegin(GL_LINE_LOOP);
+        glVertex2f(cropStartX, cropStartY);
+        glVertex2f(mx, cropStartY);
+        glVertex2f(mx, my);
+        glVertex2f(cropStartX, my);
+    glEnd();
+    
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
+}
+
 void
 Window::handle_mouse()
 {
+    if (cropSelecting)
+    {
+        handle_cropSelection();
+        glfwGetMousePos(&mouseX, &mouseY);
+        return;
+    }
     int x = mouseX;
     int y = mouseY;
     glfwGetMousePos(&mouseX, &mouseY);
@@ -268,9 +449,65 @@ Window::handle_keyboardInteraction()
         render =true;
     }
     if (glfwGetKey('t') || glfwGetKey('T')) {
-        if (renderMode != RENDER_RAYTRACE)
+        // full frames are refined from 1/8 resolution, crops are traced directly
+        RenderMode mode = hasCrop ? RENDER_RAYTRACE : RENDER_PREVIEW;
+        if (renderMode != mode)
+        {
+            if (photonMapper != NULL)
+                photonMapper->resetPreview();
             render = true;
-        renderMode = RENDER_RAYTRACE;
+        }
+        renderMode = mode;
+    }
+    if (glfwGetKey('s') || glfwGetKey('S')) {
+        if (renderMode != RENDER_SPPM)
+        {
+            delete progressiveRenderer;
+            progressiveRenderer = NULL;
+            render = true;
+        }
+        renderMode = RENDER_SPPM;
+    }
+    if (glfwGetKey('p') || glfwGetKey('P')) {
+        if (renderMode != RENDER_PROGRESSIVE)
+        {
+            if (photonMapper != NULL)
+                photonMapper->resetAccumulation();
+            render = true;
+        }
+        renderMode = RENDER_PROGRESSIVE;
+    }
+    if (glfwGetKey('c') || glfwGetKey('C')) {
+        if (!cropSelecting)
+            std::cout << "Drag a rectangle to set the crop window" << std::endl;
+        cropSelecting = true;
+    }
+    if (glfwGetKey('x') || glfwGetKey('X')) {
+        if (hasCrop)
+            std::cout << "Crop window cleared" << std::endl;
+        hasCrop = false;
+        cropSelecting = false;
+        cropDragging = false;
+    }
+    // 'D' toggles the denoiser and applies it to the last raytraced image
+    bool denoisePressed = glfwGetKey('d') || glfwGetKey('D');
+    if (denoisePressed && !denoiseKey) {
+        scene.denoise = !scene.denoise;
+        std::cout << "Denoising " << (scene.denoise ? "on" : "off") << std::endl;
+        if (scene.denoise && photonMapper != NULL && renderMode != RENDER_PROGRESSIVE
+            && photonMapper->image().sizeX() == scene.camera.xRes()
+            && photonMapper->image().sizeY() == scene.camera.yRes())
+        {
+            photonMapper->denoise(scene);
+            photonMapper->display();
+            glfwSwapBuffers();
+        }
+    }
+    denoiseKey = denoisePressed;
+    if (glfwGetKey('a') || glfwGetKey('A')) {
+        if (renderMode != RENDER_ADAPTIVE)
+            render = true;
+        renderMode = RENDER_ADAPTIVE;
     }
     if (glfwGetKey('r') || glfwGetKey('R')) {
         render = true;
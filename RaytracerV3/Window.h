@@ -11,11 +11,18 @@
 #include "platform_includes.h"
 #include "Scene.h"
 #include "SceneLoader.h"
+#include "TileScheduler.h"
+class ProgressivePhotonMapper;
+class PhotonMapper;
 namespace Main {
 
     enum RenderMode {
         RENDER_GL,
-        RENDER_RAYTRACE
+        RENDER_RAYTRACE,
+        RENDER_SPPM,
+        RENDER_PROGRESSIVE,
+        RENDER_ADAPTIVE,
+        RENDER_PREVIEW
     };
     
     class Window
@@ -31,8 +38,24 @@ namespace Main {
         int mouseY;
         
         RenderMode renderMode;
+        ProgressivePhotonMapper *progressiveRenderer;
+        PhotonMapper *photonMapper;
+        void resetAccumulation();
+        
+        // Crop window: 'C' and a drag with the left mouse button select
+        // it, 'X' clears it. Raytracing then only traces these pixels.
+        bool cropSelecting;
+        bool cropDragging;
+        int cropStartX;
+        int cropStartY;
+        bool hasCrop;
+        bool denoiseKey;
+        TileScheduler::Tile crop;
+        void handle_cropSelection();
+        void drawCropSelection() const;
     public:
         Window(uint width=1024, uint height=768);
+        ~Window();
         void mainLoop();
         void updateWindowInformation();
         void getKeyboardInput(double dt);
@@ -0,0 +1,15 @@
+//
+//  main_headless.cpp
+//  RaytracerV3
+//
+//  Entry point for rendering without a window, e.g. on render nodes.
+//  Build with RAYTRACER_HEADLESS defined to drop all OpenGL code.
+//
+#include "BatchRenderer.h"
+
+int main(int argc, const char * argv[])
+{
+    using namespace Main;
+    BatchRenderer renderer(argc, argv);
+    return renderer.run();
+}